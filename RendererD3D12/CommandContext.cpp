@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "CommandContext.h"
+#include "CommandListState.h"
 
 /*
 ====================
@@ -16,16 +17,17 @@ CommandContext::~CommandContext()
 	CleanUp();
 }
 
-bool CommandContext::Initialize(ID3D12Device5* device, uint32 maxNumCmdList)
+bool CommandContext::Initialize(ID3D12Device5* device, uint32 initialNumCmdList)
 {
-	if (maxNumCmdList < 2)
+	m_device = device;
+	m_cmdListState = new CommandListState;
+
+	for (uint32 i = 0; i < initialNumCmdList; i++)
 	{
-		__debugbreak();
+		DL_LIST* link = reinterpret_cast<DL_LIST*>(AddCmdCtx());
+		DL_InsertBack(&m_availCmdCtxHead, &m_availCmdCtxTail, link);
 	}
 
-	m_device = device;
-	m_maxNumCmdList = maxNumCmdList;
-
 	return true;
 }
 
@@ -54,6 +56,7 @@ COMMAND_CONTEXT_HANDLE* CommandContext::AllocCmdCtx()
 void CommandContext::Free()
 {
 	m_allocNum = 0;
+	m_cmdListState->ResetCounters();
 
 	DL_LIST* cur = m_usedCmdCtxHead;
 	while (cur != nullptr)
@@ -86,6 +89,7 @@ void CommandContext::Close()
 	ThrowIfFailed(cmdList->Close());
 
 	m_curCmdCtxHandle = nullptr;
+	m_cmdListState->Reset(nullptr);
 }
 
 void CommandContext::CloseAndExcute(ID3D12CommandQueue* cmdQueue)
@@ -102,6 +106,7 @@ void CommandContext::CloseAndExcute(ID3D12CommandQueue* cmdQueue)
 	cmdQueue->ExecuteCommandLists(1, cmdLists);
 
 	m_curCmdCtxHandle = nullptr;
+	m_cmdListState->Reset(nullptr);
 }
 
 ID3D12GraphicsCommandList* CommandContext::GetCurrentCommandList()
@@ -117,13 +122,37 @@ ID3D12GraphicsCommandList* CommandContext::GetCurrentCommandList()
 		}
 
 		m_curCmdCtxHandle = cmdCtxHandle;
+		m_cmdListState->Reset(cmdCtxHandle->cmdList);
 	}
 
 	return m_curCmdCtxHandle->cmdList;
 }
 
+CommandListState* CommandContext::GetCurrentCommandListState()
+{
+	GetCurrentCommandList();
+
+	return m_cmdListState;
+}
+
+uint32 CommandContext::GetIssuedStateCount()
+{
+	return m_cmdListState->GetIssuedCount();
+}
+
+uint32 CommandContext::GetSkippedStateCount()
+{
+	return m_cmdListState->GetSkippedCount();
+}
+
 void CommandContext::CleanUp()
 {
+	if (m_cmdListState)
+	{
+		delete m_cmdListState;
+		m_cmdListState = nullptr;
+	}
+
 	DL_LIST* cur = m_usedCmdCtxHead;
 	while (cur != nullptr)
 	{
@@ -151,11 +180,6 @@ void CommandContext::CleanUp()
 
 COMMAND_CONTEXT_HANDLE* CommandContext::AddCmdCtx()
 {
-	if (m_allocNum >= m_maxNumCmdList)
-	{
-		__debugbreak();
-	}
-
 	ID3D12GraphicsCommandList* cmdList = nullptr;
 	ID3D12CommandAllocator* cmdAllocator = nullptr;
 	COMMAND_CONTEXT_HANDLE* cmdCtxHandle = new COMMAND_CONTEXT_HANDLE;
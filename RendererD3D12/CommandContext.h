@@ -6,19 +6,26 @@ CommandContext
 ====================
 */
 
+class CommandListState;
+
 class CommandContext
 {
 public:
 	CommandContext();
 	~CommandContext();
 
-	bool Initialize(ID3D12Device5* device, uint32 maxNumCmdList);
+	// initialNumCmdList lists are created up front, the pool grows when a frame needs more.
+	bool Initialize(ID3D12Device5* device, uint32 initialNumCmdList);
 	COMMAND_CONTEXT_HANDLE* AllocCmdCtx();
 	void Free();
 	void Close();
 	void CloseAndExcute(ID3D12CommandQueue* cmdQueue);
 	ID3D12GraphicsCommandList* GetCurrentCommandList();
+	// Same command list as GetCurrentCommandList, with redundant state calls filtered.
+	CommandListState* GetCurrentCommandListState();
 	inline uint32 GetCmdListCount() { return m_cmdListNum; }
+	uint32 GetIssuedStateCount();
+	uint32 GetSkippedStateCount();
 
 private:
 	void CleanUp();
@@ -32,7 +39,7 @@ private:
 	DL_LIST* m_usedCmdCtxHead = nullptr;
 	DL_LIST* m_usedCmdCtxTail = nullptr;
 	COMMAND_CONTEXT_HANDLE* m_curCmdCtxHandle = nullptr;
-	uint32 m_maxNumCmdList = 0;
+	CommandListState* m_cmdListState = nullptr;
 	uint32 m_allocNum = 0;
 	uint32 m_cmdListNum = 0;
 };
@@ -0,0 +1,148 @@
+#include "pch.h"
+#include "CommandListState.h"
+
+/*
+====================
+CommandListState
+====================
+*/
+
+CommandListState::CommandListState()
+{
+}
+
+CommandListState::~CommandListState()
+{
+}
+
+void CommandListState::Reset(ID3D12GraphicsCommandList* cmdList)
+{
+	// A freshly reset command list inherits nothing, so forget everything that was bound.
+	m_cmdList = cmdList;
+	m_rootSignature = nullptr;
+	m_pipelineState = nullptr;
+	m_descHeap = nullptr;
+	m_primitiveTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	m_viewportValid = false;
+	m_scissorRectValid = false;
+	m_renderTargetValid = false;
+	m_vbViewValid = false;
+	m_ibViewValid = false;
+}
+
+void CommandListState::ResetCounters()
+{
+	m_issuedCount = 0;
+	m_skippedCount = 0;
+}
+
+void CommandListState::SetViewport(const D3D12_VIEWPORT* viewport)
+{
+	bool changed = !m_viewportValid || memcmp(&m_viewport, viewport, sizeof(D3D12_VIEWPORT)) != 0;
+	if (Update(changed))
+	{
+		m_viewport = *viewport;
+		m_viewportValid = true;
+		m_cmdList->RSSetViewports(1, viewport);
+	}
+}
+
+void CommandListState::SetScissorRect(const D3D12_RECT* scissorRect)
+{
+	bool changed = !m_scissorRectValid || memcmp(&m_scissorRect, scissorRect, sizeof(D3D12_RECT)) != 0;
+	if (Update(changed))
+	{
+		m_scissorRect = *scissorRect;
+		m_scissorRectValid = true;
+		m_cmdList->RSSetScissorRects(1, scissorRect);
+	}
+}
+
+void CommandListState::SetRenderTarget(D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle)
+{
+	bool changed = !m_renderTargetValid || m_rtvHandle.ptr != rtvHandle.ptr || m_dsvHandle.ptr != dsvHandle.ptr;
+	if (Update(changed))
+	{
+		m_rtvHandle = rtvHandle;
+		m_dsvHandle = dsvHandle;
+		m_renderTargetValid = true;
+		m_cmdList->OMSetRenderTargets(1, &rtvHandle, false, &dsvHandle);
+	}
+}
+
+void CommandListState::SetRootSignature(ID3D12RootSignature* rootSignature)
+{
+	if (Update(m_rootSignature != rootSignature))
+	{
+		m_rootSignature = rootSignature;
+		m_cmdList->SetGraphicsRootSignature(rootSignature);
+	}
+}
+
+void CommandListState::SetPipelineState(ID3D12PipelineState* pipelineState)
+{
+	if (Update(m_pipelineState != pipelineState))
+	{
+		m_pipelineState = pipelineState;
+		m_cmdList->SetPipelineState(pipelineState);
+	}
+}
+
+void CommandListState::SetDescriptorHeap(ID3D12DescriptorHeap* descHeap)
+{
+	if (Update(m_descHeap != descHeap))
+	{
+		m_descHeap = descHeap;
+		m_cmdList->SetDescriptorHeaps(1, &descHeap);
+	}
+}
+
+void CommandListState::SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology)
+{
+	if (Update(m_primitiveTopology != primitiveTopology))
+	{
+		m_primitiveTopology = primitiveTopology;
+		m_cmdList->IASetPrimitiveTopology(primitiveTopology);
+	}
+}
+
+void CommandListState::SetVertexBuffer(const D3D12_VERTEX_BUFFER_VIEW* vbView)
+{
+	bool changed = !m_vbViewValid || memcmp(&m_vbView, vbView, sizeof(D3D12_VERTEX_BUFFER_VIEW)) != 0;
+	if (Update(changed))
+	{
+		m_vbView = *vbView;
+		m_vbViewValid = true;
+		m_cmdList->IASetVertexBuffers(0, 1, vbView);
+	}
+}
+
+void CommandListState::SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* ibView)
+{
+	bool changed = !m_ibViewValid || memcmp(&m_ibView, ibView, sizeof(D3D12_INDEX_BUFFER_VIEW)) != 0;
+	if (Update(changed))
+	{
+		m_ibView = *ibView;
+		m_ibViewValid = true;
+		m_cmdList->IASetIndexBuffer(ibView);
+	}
+}
+
+bool CommandListState::Update(bool changed)
+{
+	if (!m_cmdList)
+	{
+		__debugbreak();
+	}
+
+	if (changed)
+	{
+		m_issuedCount++;
+	}
+	else
+	{
+		m_skippedCount++;
+	}
+
+	return changed;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+====================
+CommandListState
+====================
+*/
+
+// Remembers what was last bound on a command list and drops calls that would not change it.
+class CommandListState
+{
+public:
+	CommandListState();
+	~CommandListState();
+
+	void Reset(ID3D12GraphicsCommandList* cmdList);
+	void ResetCounters();
+
+	void SetViewport(const D3D12_VIEWPORT* viewport);
+	void SetScissorRect(const D3D12_RECT* scissorRect);
+	void SetRenderTarget(D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle);
+	void SetRootSignature(ID3D12RootSignature* rootSignature);
+	void SetPipelineState(ID3D12PipelineState* pipelineState);
+	void SetDescriptorHeap(ID3D12DescriptorHeap* descHeap);
+	void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology);
+	void SetVertexBuffer(const D3D12_VERTEX_BUFFER_VIEW* vbView);
+	void SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* ibView);
+
+	inline ID3D12GraphicsCommandList* GetCommandList() { return m_cmdList; }
+	inline uint32 GetIssuedCount() { return m_issuedCount; }
+	inline uint32 GetSkippedCount() { return m_skippedCount; }
+
+private:
+	bool Update(bool changed);
+
+private:
+	ID3D12GraphicsCommandList* m_cmdList = nullptr;
+	D3D12_VIEWPORT m_viewport = {};
+	D3D12_RECT m_scissorRect = {};
+	D3D12_CPU_DESCRIPTOR_HANDLE m_rtvHandle = {};
+	D3D12_CPU_DESCRIPTOR_HANDLE m_dsvHandle = {};
+	ID3D12RootSignature* m_rootSignature = nullptr;
+	ID3D12PipelineState* m_pipelineState = nullptr;
+	ID3D12DescriptorHeap* m_descHeap = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY m_primitiveTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	D3D12_VERTEX_BUFFER_VIEW m_vbView = {};
+	D3D12_INDEX_BUFFER_VIEW m_ibView = {};
+	bool m_viewportValid = false;
+	bool m_scissorRectValid = false;
+	bool m_renderTargetValid = false;
+	bool m_vbViewValid = false;
+	bool m_ibViewValid = false;
+	uint32 m_issuedCount = 0;
+	uint32 m_skippedCount = 0;
+};
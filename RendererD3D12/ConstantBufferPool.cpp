@@ -16,84 +16,133 @@ ConstantBufferPool::~ConstantBufferPool()
 	CleanUp();
 }
 
-bool ConstantBufferPool::Initialize(ID3D12Device5* device, uint32 cbTypeSize, uint32 maxNumCbv)
+bool ConstantBufferPool::Initialize(ID3D12Device5* device, uint32 initialSize)
 {
-	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	heapDesc.NumDescriptors = maxNumCbv;
-	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-	ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_descriptorHeap)));
+	m_device = device;
+	m_minPageCount = (initialSize + PAGE_SIZE - 1) / PAGE_SIZE;
 
-	m_allocatedSize = 0;
-	m_maxNumCbv = maxNumCbv;
-	m_heapTypeSize = device->GetDescriptorHandleIncrementSize(heapDesc.Type);
-
-	uint32 bufSize = cbTypeSize * m_maxNumCbv;
-	ThrowIfFailed(device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE, &CD3DX12_RESOURCE_DESC::Buffer(bufSize), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&m_cbResource)));
+	for (uint32 i = 0; i < m_minPageCount; i++)
+	{
+		CONSTANT_BUFFER_PAGE* page = CreatePage();
+		page->next = m_freePageHead;
+		m_freePageHead = page;
+	}
 
-	CD3DX12_RANGE writeRange(0, 0);		// We do not intend to write from this resource on the CPU.
-	m_cbResource->Map(0, &writeRange, reinterpret_cast<void**>(&m_sysMemArr));
+	return true;
+}
 
-	D3D12_CONSTANT_BUFFER_VIEW_DESC cbViewDesc = {};
-	cbViewDesc.BufferLocation = m_cbResource->GetGPUVirtualAddress();
-	cbViewDesc.SizeInBytes = cbTypeSize;
+void ConstantBufferPool::CleanUp()
+{
+	Free();
 
-	m_cb = new ConstantBuffer[maxNumCbv];
+	while (m_freePageHead)
+	{
+		CONSTANT_BUFFER_PAGE* page = m_freePageHead;
+		m_freePageHead = page->next;
+		DestroyPage(page);
+	}
+}
 
-	uint8* sysMemAddr = m_sysMemArr;
-	CD3DX12_CPU_DESCRIPTOR_HANDLE cbvHandle(m_descriptorHeap->GetCPUDescriptorHandleForHeapStart());
+uint8* ConstantBufferPool::Alloc(uint32 size, D3D12_GPU_VIRTUAL_ADDRESS* gpuMemAddr)
+{
+	// m_pageOffset always stays aligned, so rounding the size keeps the next allocation aligned too.
+	uint32 requiredSize = D3DUtils::GetRequiredConstantDataSize(size);
+	if (requiredSize > PAGE_SIZE)
+	{
+		__debugbreak();
+		return nullptr;
+	}
 
-	for (uint32 i = 0; i < m_maxNumCbv; i++)
+	if (!m_usedPageHead || m_pageOffset + requiredSize > PAGE_SIZE)
 	{
-		device->CreateConstantBufferView(&cbViewDesc, cbvHandle);
+		CONSTANT_BUFFER_PAGE* page = m_freePageHead;
+		if (page)
+		{
+			m_freePageHead = page->next;
+		}
+		else
+		{
+			page = CreatePage();
+		}
+
+		page->next = m_usedPageHead;
+		m_usedPageHead = page;
+		m_usedPageCount++;
+		m_pageOffset = 0;
+	}
 
-		m_cb[i].sysMemAddr = sysMemAddr;
-		m_cb[i].gpuMemAddr = cbViewDesc.BufferLocation;
-		m_cb[i].cbvCpuHandle = cbvHandle;
+	uint32 offset = m_pageOffset;
+	m_pageOffset += requiredSize;
+	m_allocatedSize += requiredSize;
+	m_requestedSize += size;
 
-		sysMemAddr += cbTypeSize;
-		cbViewDesc.BufferLocation += cbTypeSize;
-		cbvHandle.Offset(1, m_heapTypeSize);
-	}
+	*gpuMemAddr = m_usedPageHead->gpuMemAddr + offset;
 
-	return true;
+	return m_usedPageHead->sysMemAddr + offset;
 }
 
-void ConstantBufferPool::CleanUp()
+void ConstantBufferPool::Free()
 {
-	if (m_cb)
+	while (m_usedPageHead)
 	{
-		delete[] m_cb;
-		m_cb = nullptr;
+		CONSTANT_BUFFER_PAGE* page = m_usedPageHead;
+		m_usedPageHead = page->next;
+		page->next = m_freePageHead;
+		m_freePageHead = page;
 	}
-	if (m_cbResource)
+
+	if (m_usedPageCount > m_peakPageCount)
 	{
-		m_cbResource->Release();
-		m_cbResource = nullptr;
+		m_peakPageCount = m_usedPageCount;
 	}
-	if (m_descriptorHeap)
+
+	// Release the pages no frame needed over the last SHRINK_FRAME_COUNT frames, keeping the initial ones.
+	m_frameCount++;
+	if (m_frameCount >= SHRINK_FRAME_COUNT)
 	{
-		m_descriptorHeap->Release();
-		m_descriptorHeap = nullptr;
+		uint32 keepPageCount = m_peakPageCount > m_minPageCount ? m_peakPageCount : m_minPageCount;
+		while (m_pageCount > keepPageCount && m_freePageHead)
+		{
+			CONSTANT_BUFFER_PAGE* page = m_freePageHead;
+			m_freePageHead = page->next;
+			DestroyPage(page);
+		}
+
+		m_peakPageCount = 0;
+		m_frameCount = 0;
 	}
+
+	m_pageOffset = 0;
+	m_allocatedSize = 0;
+	m_requestedSize = 0;
+	m_usedPageCount = 0;
+	m_persistentHitCount = 0;
+	m_persistentMissCount = 0;
 }
 
-ConstantBuffer* ConstantBufferPool::Alloc()
+CONSTANT_BUFFER_PAGE* ConstantBufferPool::CreatePage()
 {
-	if (m_allocatedSize >= m_maxNumCbv)
-	{
-		__debugbreak();
-	}
+	CONSTANT_BUFFER_PAGE* page = new CONSTANT_BUFFER_PAGE;
 
-	ConstantBuffer* cb = nullptr;
+	ThrowIfFailed(m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE, &CD3DX12_RESOURCE_DESC::Buffer(PAGE_SIZE), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&page->resource)));
 
-	cb = m_cb + m_allocatedSize;
-	m_allocatedSize++;
+	CD3DX12_RANGE writeRange(0, 0);		// We do not intend to read from this resource on the CPU.
+	page->resource->Map(0, &writeRange, reinterpret_cast<void**>(&page->sysMemAddr));
+	page->gpuMemAddr = page->resource->GetGPUVirtualAddress();
 
-	return cb;
+	m_pageCount++;
+
+	return page;
 }
 
-void ConstantBufferPool::Free()
+void ConstantBufferPool::DestroyPage(CONSTANT_BUFFER_PAGE* page)
 {
-	m_allocatedSize = 0;
+	if (page->resource)
+	{
+		page->resource->Release();
+		page->resource = nullptr;
+	}
+	delete page;
+
+	m_pageCount--;
 }
@@ -6,35 +6,60 @@ ConstantBufferPool
 ===================
 */
 
-// class ConstantBuffer;
-
-struct ConstantBuffer
+// One upload buffer of the chain. Pages are only ever handed back whole.
+struct CONSTANT_BUFFER_PAGE
 {
+	ID3D12Resource* resource = nullptr;
 	uint8* sysMemAddr = nullptr;
-	D3D12_GPU_VIRTUAL_ADDRESS gpuMemAddr;
-	D3D12_CPU_DESCRIPTOR_HANDLE cbvCpuHandle = {};
+	D3D12_GPU_VIRTUAL_ADDRESS gpuMemAddr = 0;
+	CONSTANT_BUFFER_PAGE* next = nullptr;
 };
 
+// Per frame chain of upload pages that draws sub-allocate their constants from. Bound as root CBVs by address, so no descriptors.
 class ConstantBufferPool
 {
 public:
+	static const uint32 PAGE_SIZE = 64 * 1024;		// also the largest constant buffer a shader can bind
+	static const uint32 SHRINK_FRAME_COUNT = 120;
+
 	ConstantBufferPool();
 	~ConstantBufferPool();
 
-	bool Initialize(ID3D12Device5* device, uint32 cbTypeSize, uint32 maxNumCbv);
+	bool Initialize(ID3D12Device5* device, uint32 initialSize);
 	void CleanUp();
 
-	ConstantBuffer* Alloc();
+	// Any size up to PAGE_SIZE, every allocation starts on a 256 byte boundary. Grows by a page when the current one is full.
+	uint8* Alloc(uint32 size, D3D12_GPU_VIRTUAL_ADDRESS* gpuMemAddr);
+	// Call once the frame that used the pool has retired on the GPU. Its pages go back to the free list.
 	void Free();
 
+	inline uint32 GetAllocatedSize() { return m_allocatedSize; }
+	// Bytes the callers asked for, which is what they write. The alignment padding is never touched.
+	inline uint32 GetRequestedSize() { return m_requestedSize; }
+	inline uint32 GetPageCount() { return m_pageCount; }
+	inline uint64 GetResidentSize() { return static_cast<uint64>(m_pageCount) * PAGE_SIZE; }
+	// Draws of the frame that reused or rewrote a persistent slot instead of allocating here. Kept per thread to stay uncontended.
+	inline void CountPersistentHit() { m_persistentHitCount++; }
+	inline void CountPersistentMiss() { m_persistentMissCount++; }
+	inline uint32 GetPersistentHitCount() { return m_persistentHitCount; }
+	inline uint32 GetPersistentMissCount() { return m_persistentMissCount; }
+
 private:
-	ID3D12DescriptorHeap* m_descriptorHeap = nullptr;
-	uint32 m_allocatedSize = 0;
-	uint32 m_maxNumCbv = 0;
-	uint32 m_heapTypeSize = 0;
+	CONSTANT_BUFFER_PAGE* CreatePage();
+	void DestroyPage(CONSTANT_BUFFER_PAGE* page);
 
-	ID3D12Resource* m_cbResource = nullptr;
-	ConstantBuffer* m_cb = nullptr;
-	uint8* m_sysMemArr = nullptr;
+private:
+	ID3D12Device5* m_device = nullptr;
+	CONSTANT_BUFFER_PAGE* m_usedPageHead = nullptr;		// the head is the page being filled
+	CONSTANT_BUFFER_PAGE* m_freePageHead = nullptr;
+	uint32 m_pageOffset = 0;
+	uint32 m_allocatedSize = 0;
+	uint32 m_requestedSize = 0;
+	uint32 m_pageCount = 0;
+	uint32 m_minPageCount = 0;
+	uint32 m_usedPageCount = 0;
+	uint32 m_peakPageCount = 0;		// most pages one frame used since the last shrink
+	uint32 m_frameCount = 0;
+	uint32 m_persistentHitCount = 0;
+	uint32 m_persistentMissCount = 0;
 };
-
@@ -0,0 +1,59 @@
+#include "pch.h"
+#include "ConstantWriter.h"
+#include <immintrin.h>
+
+/*
+=================
+ConstantWriter
+=================
+*/
+
+void ConstantWriter::Write(void* dest, const void* src, uint32 size)
+{
+	if (reinterpret_cast<uintptr_t>(dest) & (LINE_SIZE - 1))
+	{
+		__debugbreak();
+	}
+
+	uint8* destLine = reinterpret_cast<uint8*>(dest);
+	const uint8* srcLine = reinterpret_cast<const uint8*>(src);
+	uint32 lineCount = (size + LINE_SIZE - 1) / LINE_SIZE;
+
+	for (uint32 i = 0; i < lineCount; i++)
+	{
+		// Stage partial lines so every line still leaves in full, a partial line would flush the combining buffer early.
+		alignas(LINE_SIZE) uint8 stage[LINE_SIZE];
+		const uint8* line = srcLine;
+		uint32 remainSize = size - i * LINE_SIZE;
+		if (remainSize < LINE_SIZE)
+		{
+			memcpy(stage, srcLine, remainSize);
+			memset(stage + remainSize, 0, LINE_SIZE - remainSize);
+			line = stage;
+		}
+
+#if defined(__AVX__)
+		__m256i data0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line));
+		__m256i data1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + 32));
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(destLine), data0);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(destLine + 32), data1);
+#else
+		__m128i data0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line));
+		__m128i data1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + 16));
+		__m128i data2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + 32));
+		__m128i data3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + 48));
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destLine), data0);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destLine + 16), data1);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destLine + 32), data2);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(destLine + 48), data3);
+#endif
+
+		destLine += LINE_SIZE;
+		srcLine += LINE_SIZE;
+	}
+}
+
+void ConstantWriter::Flush()
+{
+	_mm_sfence();
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+/*
+=================
+ConstantWriter
+=================
+*/
+
+// Writes into write-combined upload memory with non-temporal stores, whole 64 byte lines at a time.
+class ConstantWriter
+{
+public:
+	static const uint32 LINE_SIZE = 64;
+
+	// dest must be LINE_SIZE aligned with room for size rounded up to LINE_SIZE. The tail of the last line is zero filled.
+	static void Write(void* dest, const void* src, uint32 size);
+	// Orders the streamed stores before anything the thread does next. Call before the GPU may read them.
+	static void Flush();
+};
@@ -115,6 +115,25 @@ void D3DUtils::PrintError(ID3DBlob* error)
 	}
 }
 
+bool D3DUtils::CompileOptionalShader(const wchar_t* filename, const char* entryPoint, const char* target, UINT compileFlags, ID3DBlob** shader)
+{
+	ID3DBlob* error = nullptr;
+	if (SUCCEEDED(D3DCompileFromFile(filename, nullptr, nullptr, entryPoint, target, compileFlags, 0, shader, &error)))
+	{
+		return true;
+	}
+
+	// The caller only keeps its old path, so log the error instead of going through PrintError, which breaks.
+	if (error)
+	{
+		OutputDebugStringA(reinterpret_cast<const char*>(error->GetBufferPointer()));
+		error->Release();
+	}
+	*shader = nullptr;
+
+	return false;
+}
+
 uint32 D3DUtils::GetRequiredConstantDataSize(uint32 originSize)
 {
 	return (originSize + 255) & ~255;
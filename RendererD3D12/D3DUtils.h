@@ -19,6 +19,8 @@ public:
 	static void GetHardwareAdapter(IDXGIFactory1* pFactory, IDXGIAdapter1** ppAdapter, bool requestHighPerformanceAdapter = false);
 	static void SetDebugLayerInfo(ID3D12Device* device);
 	static void PrintError(ID3DBlob* error);
+	// For entries a shader may leave out. Returns false without breaking when the entry does not compile.
+	static bool CompileOptionalShader(const wchar_t* filename, const char* entryPoint, const char* target, UINT compileFlags, ID3DBlob** shader);
 	static uint32 GetRequiredConstantDataSize(uint32 originSize);
 	static void UpdateTexture(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, ID3D12Resource* texResource, ID3D12Resource* uploadBuufer);
 };
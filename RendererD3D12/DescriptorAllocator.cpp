@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "DescriptorAllocator.h"
+#include "IndexAllocator.h"
 #include "D3DUtils.h"
 
 /*
@@ -17,27 +18,51 @@ DescriptorAllocator::~DescriptorAllocator()
 	CleanUp();
 }
 
-bool DescriptorAllocator::Initialize(ID3D12Device5* device, uint32 maxHeapNum)
+bool DescriptorAllocator::Initialize(ID3D12Device5* device, uint32 maxDescriptorCount, uint32 transientDescriptorCount)
 {
 	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
 	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	heapDesc.NumDescriptors = maxHeapNum;
+	heapDesc.NumDescriptors = maxDescriptorCount;
 	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 
 	ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_descriptorHeap)));
 
-	m_maxHeapNum = maxHeapNum;
-	m_allocatedHeapNum = 0;
+	heapDesc.NumDescriptors = maxDescriptorCount + transientDescriptorCount;
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_shaderVisibleHeap)));
+
+	m_device = device;
+	m_shaderVisibleCount = heapDesc.NumDescriptors;
 	m_descriptorSize = device->GetDescriptorHandleIncrementSize(heapDesc.Type);
 
+	m_indexAllocator = new IndexAllocator;
+	m_indexAllocator->Initialize(maxDescriptorCount);
+
+	// Draws without a texture index this slot instead of a descriptor nobody wrote.
+	D3D12_SHADER_RESOURCE_VIEW_DESC nullSrvDesc = {};
+	nullSrvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	nullSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	nullSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	nullSrvDesc.Texture2D.MipLevels = 1;
+
+	m_nullSrvHandle = m_indexAllocator->Alloc();
+	CreateShaderResourceView(m_nullSrvHandle, nullptr, &nullSrvDesc);
+
 	return true;
 }
 
 void DescriptorAllocator::CleanUp()
 {
-	m_allocatedHeapNum = 0;
-	m_maxHeapNum = 0;
-
+	if (m_indexAllocator)
+	{
+		delete m_indexAllocator;
+		m_indexAllocator = nullptr;
+	}
+	if (m_shaderVisibleHeap)
+	{
+		m_shaderVisibleHeap->Release();
+		m_shaderVisibleHeap = nullptr;
+	}
 	if (m_descriptorHeap)
 	{
 		m_descriptorHeap->Release();
@@ -45,21 +70,57 @@ void DescriptorAllocator::CleanUp()
 	}
 }
 
-void DescriptorAllocator::AllocateDescriptorHeap(D3D12_CPU_DESCRIPTOR_HANDLE* cpuHandle)
+uint32 DescriptorAllocator::Alloc(D3D12_CPU_DESCRIPTOR_HANDLE* cpuHandle)
+{
+	return AllocRange(1, cpuHandle);
+}
+
+uint32 DescriptorAllocator::AllocRange(uint32 count, D3D12_CPU_DESCRIPTOR_HANDLE* cpuHandle)
+{
+	uint32 handle = m_indexAllocator->AllocRange(count);
+	if (handle == IndexAllocator::INVALID_HANDLE)
+	{
+		cpuHandle->ptr = 0;
+		return handle;
+	}
+
+	*cpuHandle = GetCpuHandle(handle);
+
+	return handle;
+}
+
+void DescriptorAllocator::Free(uint32 handle)
+{
+	FreeRange(handle, 1);
+}
+
+void DescriptorAllocator::FreeRange(uint32 handle, uint32 count)
 {
-	if (m_allocatedHeapNum >= m_maxHeapNum)
+	if (!m_indexAllocator->FreeRange(handle, count))
 	{
+		// Freed twice, or freed through a handle whose slot was already reused.
 		__debugbreak();
 	}
+}
 
-	CD3DX12_CPU_DESCRIPTOR_HANDLE descriptorHandle(m_descriptorHeap->GetCPUDescriptorHandleForHeapStart(), m_allocatedHeapNum, m_descriptorSize);
-	*cpuHandle = descriptorHandle;
-	m_allocatedHeapNum++;
+bool DescriptorAllocator::IsValid(uint32 handle)
+{
+	return m_indexAllocator->IsValid(handle);
 }
 
-void DescriptorAllocator::FreeDecriptorHeap(D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle)
+void DescriptorAllocator::CreateShaderResourceView(uint32 handle, ID3D12Resource* resource, const D3D12_SHADER_RESOURCE_VIEW_DESC* srvDesc)
 {
-	m_allocatedHeapNum--;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE shaderVisibleHandle(m_shaderVisibleHeap->GetCPUDescriptorHandleForHeapStart(), IndexAllocator::GetIndex(handle), m_descriptorSize);
+
+	m_device->CreateShaderResourceView(resource, srvDesc, GetCpuHandle(handle));
+	m_device->CreateShaderResourceView(resource, srvDesc, shaderVisibleHandle);
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::GetCpuHandle(uint32 handle)
+{
+	CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle(m_descriptorHeap->GetCPUDescriptorHandleForHeapStart(), IndexAllocator::GetIndex(handle), m_descriptorSize);
+
+	return cpuHandle;
 }
 
 D3D12_GPU_DESCRIPTOR_HANDLE DescriptorAllocator::GetGpuHandleFromCpu(D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle)
@@ -71,3 +132,28 @@ D3D12_GPU_DESCRIPTOR_HANDLE DescriptorAllocator::GetGpuHandleFromCpu(D3D12_CPU_D
 
 	return gpuHandle;
 }
+
+uint32 DescriptorAllocator::GetShaderIndex(uint32 handle)
+{
+	return IndexAllocator::GetIndex(handle);
+}
+
+uint32 DescriptorAllocator::GetNullSrvIndex()
+{
+	return IndexAllocator::GetIndex(m_nullSrvHandle);
+}
+
+uint32 DescriptorAllocator::GetCapacity()
+{
+	return m_indexAllocator->GetCapacity();
+}
+
+uint32 DescriptorAllocator::GetAllocatedCount()
+{
+	return m_indexAllocator->GetAllocatedCount();
+}
+
+uint32 DescriptorAllocator::GetHighWaterMark()
+{
+	return m_indexAllocator->GetHighWaterMark();
+}
@@ -6,23 +6,49 @@ DesriptorAllocator
 ===================
 */
 
+class IndexAllocator;
+
+// Heap of persistent descriptors. Slots are named by generation checked handles from IndexAllocator,
+// so any slot can be freed in any order and a stale handle is caught instead of aliasing a live view.
+// Every SRV is written twice, once to the CPU only heap as a copy source and once to a shader visible mirror
+// at the same index, which shaders with bindless entries read straight through the slot index.
+// The shader visible heap is the only one draws bind. Past the persistent slots it holds the DescriptorRing's transient descriptors.
 class DescriptorAllocator
 {
 public:
 	DescriptorAllocator();
 	~DescriptorAllocator();
 
-	bool Initialize(ID3D12Device5* device, uint32 maxHeapNum);
+	bool Initialize(ID3D12Device5* device, uint32 maxDescriptorCount, uint32 transientDescriptorCount);
 	void CleanUp();
 
-	void AllocateDescriptorHeap(D3D12_CPU_DESCRIPTOR_HANDLE* cpuHandle);
-	void FreeDecriptorHeap(D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle);
+	// Leaves cpuHandle zero and returns IndexAllocator::INVALID_HANDLE when the heap is full.
+	uint32 Alloc(D3D12_CPU_DESCRIPTOR_HANDLE* cpuHandle);
+	uint32 AllocRange(uint32 count, D3D12_CPU_DESCRIPTOR_HANDLE* cpuHandle);
+	void Free(uint32 handle);
+	void FreeRange(uint32 handle, uint32 count);
+	bool IsValid(uint32 handle);
+	void CreateShaderResourceView(uint32 handle, ID3D12Resource* resource, const D3D12_SHADER_RESOURCE_VIEW_DESC* srvDesc);
+	D3D12_CPU_DESCRIPTOR_HANDLE GetCpuHandle(uint32 handle);
 	D3D12_GPU_DESCRIPTOR_HANDLE GetGpuHandleFromCpu(D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle);
+	// Index of the slot in the shader visible heap, what a bindless shader indexes its texture array with.
+	uint32 GetShaderIndex(uint32 handle);
+	// Slot holding a null SRV, sampling it returns zero.
+	uint32 GetNullSrvIndex();
+	inline ID3D12DescriptorHeap* GetShaderVisibleHeap() { return m_shaderVisibleHeap; }
+	inline D3D12_GPU_DESCRIPTOR_HANDLE GetShaderVisibleHeapStart() { return m_shaderVisibleHeap->GetGPUDescriptorHandleForHeapStart(); }
+
+	uint32 GetCapacity();
+	inline uint32 GetShaderVisibleCount() { return m_shaderVisibleCount; }
+	uint32 GetAllocatedCount();
+	uint32 GetHighWaterMark();
 
 private:
-	uint32 m_maxHeapNum = 0;
-	uint32 m_allocatedHeapNum = 0;
+	ID3D12Device5* m_device = nullptr;
 	uint32 m_descriptorSize = 0;
+	uint32 m_nullSrvHandle = 0;
+	uint32 m_shaderVisibleCount = 0;
 	ID3D12DescriptorHeap* m_descriptorHeap = nullptr;
+	ID3D12DescriptorHeap* m_shaderVisibleHeap = nullptr;
+	IndexAllocator* m_indexAllocator = nullptr;
 };
-
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "DescriptorPool.h"
+#include "DescriptorRing.h"
 
 /*
 ===================
@@ -16,48 +17,197 @@ DescriptorPool::~DescriptorPool()
 	CleanUp();
 }
 
-bool DescriptorPool::Initialize(ID3D12Device5* device, uint32 maxHeapNum)
+bool DescriptorPool::Initialize(ID3D12Device5* device, DescriptorRing* ring)
 {
-	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	heapDesc.NumDescriptors = maxHeapNum;
-	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	m_device = device;
+	m_ring = ring;
+	m_blockBase = 0;
+	m_blockUsed = DescriptorRing::BLOCK_SIZE;
 
-	ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_descriptorHeap)));
-
-	m_allocatedSize = 0;
-	m_maxHeapNum = maxHeapNum;
-	m_typeSize = device->GetDescriptorHandleIncrementSize(heapDesc.Type);
+	m_tableCache = new DESCRIPTOR_TABLE_CACHE_ENTRY[TABLE_CACHE_SIZE];
+	m_cacheGeneration = 1;
 
 	return true;
 }
 
 void DescriptorPool::CleanUp()
 {
-	if (m_descriptorHeap)
+	if (m_tableCache)
 	{
-		m_descriptorHeap->Release();
-		m_descriptorHeap = nullptr;
+		delete[] m_tableCache;
+		m_tableCache = nullptr;
 	}
 }
 
 void DescriptorPool::Alloc(D3D12_CPU_DESCRIPTOR_HANDLE* cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE* gpuHandle, uint32 requiredSize)
 {
-	if (m_allocatedSize >= m_maxHeapNum)
+	uint32 descriptorIdx = AllocIndex(requiredSize);
+
+	*cpuHandle = m_ring->GetCpuHandle(descriptorIdx);
+	*gpuHandle = m_ring->GetGpuHandle(descriptorIdx);
+}
+
+void DescriptorPool::AllocTable(D3D12_GPU_DESCRIPTOR_HANDLE* gpuHandle, const D3D12_CPU_DESCRIPTOR_HANDLE* srcHandles, uint32 count)
+{
+	uint32 hash = HashHandles(srcHandles, count);
+	DESCRIPTOR_TABLE_CACHE_ENTRY* emptyEntry = nullptr;
+
+	for (uint32 i = 0; i < TABLE_CACHE_MAX_PROBE_COUNT; i++)
 	{
-		__debugbreak();
+		DESCRIPTOR_TABLE_CACHE_ENTRY* entry = &m_tableCache[(hash + i) & (TABLE_CACHE_SIZE - 1)];
+		if (entry->generation != m_cacheGeneration)
+		{
+			emptyEntry = entry;
+			break;
+		}
+		if (MatchTable(entry, hash, srcHandles, count))
+		{
+			*gpuHandle = m_ring->GetGpuHandle(entry->descriptorIdx);
+			m_tableHitCount++;
+			return;
+		}
+	}
+
+	uint32 descriptorIdx = AllocIndex(count);
+	*gpuHandle = m_ring->GetGpuHandle(descriptorIdx);
+
+	QueueCopies(descriptorIdx, srcHandles, count);
+	m_tableMissCount++;
+
+	// A full probe window just leaves the table uncached, the next draw with the same handles copies again.
+	if (emptyEntry)
+	{
+		emptyEntry->hash = hash;
+		emptyEntry->descriptorIdx = descriptorIdx;
+		emptyEntry->count = count;
+		emptyEntry->generation = m_cacheGeneration;
 	}
+}
 
-	CD3DX12_CPU_DESCRIPTOR_HANDLE cpu(m_descriptorHeap->GetCPUDescriptorHandleForHeapStart(), m_allocatedSize, m_typeSize);
-	CD3DX12_GPU_DESCRIPTOR_HANDLE gpu(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), m_allocatedSize, m_typeSize);
+void DescriptorPool::FlushCopies()
+{
+	if (!m_pendingDestRangeCount)
+	{
+		return;
+	}
 
-	*cpuHandle = cpu;
-	*gpuHandle = gpu;
+	m_device->CopyDescriptors(m_pendingDestRangeCount, m_pendingDestStarts, m_pendingDestSizes, m_pendingSrcRangeCount, m_pendingSrcStarts, m_pendingSrcSizes, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	m_copyCallCount++;
 
-	m_allocatedSize += requiredSize;
+	m_pendingDestRangeCount = 0;
+	m_pendingSrcRangeCount = 0;
 }
 
 void DescriptorPool::Free()
 {
-	m_allocatedSize = 0;
+	// The rest of the current block retires with the frame.
+	m_blockUsed = DescriptorRing::BLOCK_SIZE;
+	m_copyCount = 0;
+	m_copyCallCount = 0;
+	m_pendingDestRangeCount = 0;
+	m_pendingSrcRangeCount = 0;
+	m_tableHitCount = 0;
+	m_tableMissCount = 0;
+
+	// Empties every cache entry without touching them.
+	m_cacheGeneration++;
+}
+
+uint32 DescriptorPool::GetTypeSize()
+{
+	return m_ring->GetTypeSize();
+}
+
+ID3D12DescriptorHeap* DescriptorPool::GetDesciptorHeap()
+{
+	return m_ring->GetDescriptorHeap();
+}
+
+uint32 DescriptorPool::AllocIndex(uint32 requiredSize)
+{
+	if (requiredSize > DescriptorRing::BLOCK_SIZE)
+	{
+		__debugbreak();
+	}
+
+	if (m_blockUsed + requiredSize > DescriptorRing::BLOCK_SIZE)
+	{
+		m_blockBase = m_ring->ReserveBlock();
+		m_blockUsed = 0;
+	}
+
+	uint32 descriptorIdx = m_blockBase + m_blockUsed;
+	m_blockUsed += requiredSize;
+
+	return descriptorIdx;
+}
+
+void DescriptorPool::QueueCopies(uint32 descriptorIdx, const D3D12_CPU_DESCRIPTOR_HANDLE* srcHandles, uint32 count)
+{
+	// Worst case every source is its own range.
+	if (m_pendingDestRangeCount == MAX_PENDING_COPY_RANGE_COUNT || m_pendingSrcRangeCount + count > MAX_PENDING_COPY_RANGE_COUNT)
+	{
+		FlushCopies();
+	}
+
+	uint32 typeSize = m_ring->GetTypeSize();
+	D3D12_CPU_DESCRIPTOR_HANDLE destHandle = m_ring->GetCpuHandle(descriptorIdx);
+
+	// Tables allocated one after another in a block continue the last range.
+	uint32 lastDest = m_pendingDestRangeCount - 1;
+	if (m_pendingDestRangeCount && m_pendingDestStarts[lastDest].ptr + static_cast<SIZE_T>(m_pendingDestSizes[lastDest]) * typeSize == destHandle.ptr)
+	{
+		m_pendingDestSizes[lastDest] += count;
+	}
+	else
+	{
+		m_pendingDestStarts[m_pendingDestRangeCount] = destHandle;
+		m_pendingDestSizes[m_pendingDestRangeCount] = count;
+		m_pendingDestRangeCount++;
+	}
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		uint32 lastSrc = m_pendingSrcRangeCount - 1;
+		if (m_pendingSrcRangeCount && m_pendingSrcStarts[lastSrc].ptr + static_cast<SIZE_T>(m_pendingSrcSizes[lastSrc]) * typeSize == srcHandles[i].ptr)
+		{
+			m_pendingSrcSizes[lastSrc]++;
+		}
+		else
+		{
+			m_pendingSrcStarts[m_pendingSrcRangeCount] = srcHandles[i];
+			m_pendingSrcSizes[m_pendingSrcRangeCount] = 1;
+			m_pendingSrcRangeCount++;
+		}
+		m_ring->SetSourceHandle(descriptorIdx + i, srcHandles[i].ptr);
+	}
+	m_copyCount += count;
+}
+
+uint32 DescriptorPool::HashHandles(const D3D12_CPU_DESCRIPTOR_HANDLE* srcHandles, uint32 count)
+{
+	uint64 hash = 14695981039346656037ull;
+	for (uint32 i = 0; i < count; i++)
+	{
+		hash ^= static_cast<uint64>(srcHandles[i].ptr);
+		hash *= 1099511628211ull;
+	}
+	return static_cast<uint32>(hash ^ (hash >> 32));
+}
+
+bool DescriptorPool::MatchTable(const DESCRIPTOR_TABLE_CACHE_ENTRY* entry, uint32 hash, const D3D12_CPU_DESCRIPTOR_HANDLE* srcHandles, uint32 count)
+{
+	if (entry->hash != hash || entry->count != count)
+	{
+		return false;
+	}
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		if (m_ring->GetSourceHandle(entry->descriptorIdx + i) != srcHandles[i].ptr)
+		{
+			return false;
+		}
+	}
+	return true;
 }
@@ -1,30 +1,76 @@
 #pragma once
 
+// A table already copied into the pool this frame, found again by the source handles it was copied from.
+struct DESCRIPTOR_TABLE_CACHE_ENTRY
+{
+	uint32 hash = 0;
+	uint32 descriptorIdx = 0;		// first descriptor of the table in the heap, the ring keeps its source handles
+	uint32 count = 0;
+	uint32 generation = 0;		// the entry is empty unless it matches the pool's
+};
+
 /*
 ===================
 DescriptorPool
 ===================
 */
 
+class DescriptorRing;
+
+// One thread's descriptors of one pending frame. They live in blocks reserved from the shared DescriptorRing.
 class DescriptorPool
 {
 public:
+	static const uint32 TABLE_CACHE_SIZE = 4096;
+	static const uint32 TABLE_CACHE_MAX_PROBE_COUNT = 8;
+	static const uint32 MAX_PENDING_COPY_RANGE_COUNT = 256;
+
 	DescriptorPool();
 	~DescriptorPool();
 
-	bool Initialize(ID3D12Device5* device, uint32 maxHeapNum);
+	bool Initialize(ID3D12Device5* device, DescriptorRing* ring);
 	void CleanUp();
 
+	// requiredSize is at most DescriptorRing::BLOCK_SIZE, a table never spans two blocks.
 	void Alloc(D3D12_CPU_DESCRIPTOR_HANDLE* cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE* gpuHandle, uint32 requiredSize);
+	// Returns a table holding copies of srcHandles in order. A table copied earlier in the frame from the same handles
+	// is handed out again, so only a miss allocates. Its copy is queued until FlushCopies.
+	void AllocTable(D3D12_GPU_DESCRIPTOR_HANDLE* gpuHandle, const D3D12_CPU_DESCRIPTOR_HANDLE* srcHandles, uint32 count);
+	// Issues the queued copies in one CopyDescriptors call. Call before the command list using the tables is closed.
+	void FlushCopies();
+	// Call once the GPU is done with the frame. Its blocks go back through DescriptorRing::Retire.
 	void Free();
 
-	inline uint32 GetTypeSize() { return m_typeSize; }
-	inline ID3D12DescriptorHeap* GetDesciptorHeap() { return m_descriptorHeap; }
+	uint32 GetTypeSize();
+	ID3D12DescriptorHeap* GetDesciptorHeap();
+	// Counters since the last Free.
+	inline uint32 GetCopyCount() { return m_copyCount; }
+	inline uint32 GetCopyCallCount() { return m_copyCallCount; }
+	inline uint32 GetTableHitCount() { return m_tableHitCount; }
+	inline uint32 GetTableMissCount() { return m_tableMissCount; }
 
 private:
-	ID3D12DescriptorHeap* m_descriptorHeap = nullptr;
-	uint32 m_allocatedSize = 0;
-	uint32 m_maxHeapNum = 0;
-	uint32 m_typeSize = 0;
-};
+	uint32 AllocIndex(uint32 requiredSize);
+	void QueueCopies(uint32 descriptorIdx, const D3D12_CPU_DESCRIPTOR_HANDLE* srcHandles, uint32 count);
+	static uint32 HashHandles(const D3D12_CPU_DESCRIPTOR_HANDLE* srcHandles, uint32 count);
+	bool MatchTable(const DESCRIPTOR_TABLE_CACHE_ENTRY* entry, uint32 hash, const D3D12_CPU_DESCRIPTOR_HANDLE* srcHandles, uint32 count);
 
+private:
+	ID3D12Device5* m_device = nullptr;
+	DescriptorRing* m_ring = nullptr;
+	DESCRIPTOR_TABLE_CACHE_ENTRY* m_tableCache = nullptr;
+	// Copies not issued yet. Adjacent tables and adjacent sources merge into one range.
+	D3D12_CPU_DESCRIPTOR_HANDLE m_pendingDestStarts[MAX_PENDING_COPY_RANGE_COUNT] = {};
+	uint32 m_pendingDestSizes[MAX_PENDING_COPY_RANGE_COUNT] = {};
+	D3D12_CPU_DESCRIPTOR_HANDLE m_pendingSrcStarts[MAX_PENDING_COPY_RANGE_COUNT] = {};
+	uint32 m_pendingSrcSizes[MAX_PENDING_COPY_RANGE_COUNT] = {};
+	uint32 m_pendingDestRangeCount = 0;
+	uint32 m_pendingSrcRangeCount = 0;
+	uint32 m_blockBase = 0;		// heap index of the block being filled
+	uint32 m_blockUsed = 0;
+	uint32 m_cacheGeneration = 1;
+	uint32 m_copyCount = 0;
+	uint32 m_copyCallCount = 0;
+	uint32 m_tableHitCount = 0;
+	uint32 m_tableMissCount = 0;
+};
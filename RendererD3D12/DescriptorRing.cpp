@@ -0,0 +1,186 @@
+#include "pch.h"
+#include "DescriptorRing.h"
+
+/*
+===================
+DescriptorRing
+===================
+*/
+
+DescriptorRing::DescriptorRing()
+{
+}
+
+DescriptorRing::~DescriptorRing()
+{
+	CleanUp();
+}
+
+bool DescriptorRing::Initialize(ID3D12Device5* device, ID3D12DescriptorHeap* heap, uint32 firstDescriptor, uint32 descriptorCount, uint32 frameCount, ID3D12Fence* fence)
+{
+	if (descriptorCount % BLOCK_SIZE)
+	{
+		__debugbreak();
+	}
+
+	m_descriptorHeap = heap;
+	m_cpuHeapStart = heap->GetCPUDescriptorHandleForHeapStart();
+	m_gpuHeapStart = heap->GetGPUDescriptorHandleForHeapStart();
+	m_firstDescriptor = firstDescriptor;
+	m_blockCount = descriptorCount / BLOCK_SIZE;
+	m_typeSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	m_srcHandles = new SIZE_T[descriptorCount];
+	memset(m_srcHandles, 0, sizeof(SIZE_T) * descriptorCount);
+
+	m_frameCount = frameCount;
+	m_frameEnds = new uint64[frameCount];
+	memset(m_frameEnds, 0, sizeof(uint64) * frameCount);
+	m_frameFenceValues = new uint64[frameCount];
+	memset(m_frameFenceValues, 0, sizeof(uint64) * frameCount);
+
+	m_fence = fence;
+	m_fenceEvent = ::CreateEvent(nullptr, false, false, nullptr);
+	if (!m_fenceEvent)
+	{
+		__debugbreak();
+	}
+
+	m_head = 0;
+	m_tail = 0;
+	m_highWaterMark = 0;
+	m_waitCount = 0;
+
+	return true;
+}
+
+void DescriptorRing::CleanUp()
+{
+	if (m_fenceEvent)
+	{
+		::CloseHandle(m_fenceEvent);
+		m_fenceEvent = nullptr;
+	}
+	if (m_frameFenceValues)
+	{
+		delete[] m_frameFenceValues;
+		m_frameFenceValues = nullptr;
+	}
+	if (m_frameEnds)
+	{
+		delete[] m_frameEnds;
+		m_frameEnds = nullptr;
+	}
+	if (m_srcHandles)
+	{
+		delete[] m_srcHandles;
+		m_srcHandles = nullptr;
+	}
+
+	// The heap belongs to the DescriptorAllocator, the fence to the Renderer.
+	m_descriptorHeap = nullptr;
+	m_fence = nullptr;
+}
+
+uint32 DescriptorRing::ReserveBlock()
+{
+	long long head = m_head;
+	while (true)
+	{
+		if (static_cast<uint64>(head - m_tail) >= m_blockCount)
+		{
+			// Every block is still read by a frame in flight. The head stays put so the ring never wraps onto them.
+			WaitForOldestFrame();
+			head = m_head;
+			continue;
+		}
+
+		long long prevHead = _InterlockedCompareExchange64(&m_head, head + 1, head);
+		if (prevHead == head)
+		{
+			break;
+		}
+		head = prevHead;
+	}
+
+	return m_firstDescriptor + static_cast<uint32>(static_cast<uint64>(head) % m_blockCount) * BLOCK_SIZE;
+}
+
+void DescriptorRing::EndFrame(uint32 frameIdx)
+{
+	m_frameEnds[frameIdx] = static_cast<uint64>(m_head);
+
+	uint32 reservedCount = GetReservedCount();
+	if (reservedCount > m_highWaterMark)
+	{
+		m_highWaterMark = reservedCount;
+	}
+}
+
+void DescriptorRing::Retire(uint32 frameIdx)
+{
+	std::lock_guard<std::mutex> lock(m_retireMutex);
+
+	// Frames finish in order, so the tail never moves back. A recording thread may have retired this frame already.
+	if (m_frameEnds[frameIdx] > static_cast<uint64>(m_tail))
+	{
+		m_tail = static_cast<long long>(m_frameEnds[frameIdx]);
+	}
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorRing::GetCpuHandle(uint32 descriptorIdx)
+{
+	CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle(m_cpuHeapStart, descriptorIdx, m_typeSize);
+
+	return cpuHandle;
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DescriptorRing::GetGpuHandle(uint32 descriptorIdx)
+{
+	CD3DX12_GPU_DESCRIPTOR_HANDLE gpuHandle(m_gpuHeapStart, descriptorIdx, m_typeSize);
+
+	return gpuHandle;
+}
+
+uint32 DescriptorRing::GetReservedCount()
+{
+	return static_cast<uint32>(m_head - m_tail) * BLOCK_SIZE;
+}
+
+void DescriptorRing::WaitForOldestFrame()
+{
+	std::lock_guard<std::mutex> lock(m_retireMutex);
+
+	// Another thread may have retired a frame while this one waited for the lock.
+	uint64 tail = static_cast<uint64>(m_tail);
+	if (static_cast<uint64>(m_head) - tail < m_blockCount)
+	{
+		return;
+	}
+
+	// The frame being recorded was retired before it started, so only frames in flight end past the tail.
+	uint32 oldestFrameIdx = m_frameCount;
+	for (uint32 i = 0; i < m_frameCount; i++)
+	{
+		if (m_frameEnds[i] > tail && (oldestFrameIdx == m_frameCount || m_frameEnds[i] < m_frameEnds[oldestFrameIdx]))
+		{
+			oldestFrameIdx = i;
+		}
+	}
+	if (oldestFrameIdx == m_frameCount)
+	{
+		// The frame being recorded holds every block by itself.
+		__debugbreak();
+	}
+
+	_InterlockedIncrement(&m_waitCount);
+
+	uint64 fenceValue = m_frameFenceValues[oldestFrameIdx];
+	if (m_fence->GetCompletedValue() < fenceValue)
+	{
+		m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent);
+		::WaitForSingleObject(m_fenceEvent, INFINITE);
+	}
+
+	m_tail = static_cast<long long>(m_frameEnds[oldestFrameIdx]);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+===================
+DescriptorRing
+===================
+*/
+
+// Transient part of the shader visible heap, shared by every recording thread. Threads reserve whole blocks without
+// a lock and sub-allocate inside them. The blocks of a pending frame go back once the GPU passed that frame's fence.
+// A thread finding every block in flight waits for the oldest frame's fence instead of wrapping onto it.
+class DescriptorRing
+{
+public:
+	static const uint32 BLOCK_SIZE = 256;
+
+	DescriptorRing();
+	~DescriptorRing();
+
+	// Takes descriptorCount descriptors of heap starting at firstDescriptor, a multiple of BLOCK_SIZE.
+	// fence is the one every pending frame signals, see SetFrameFenceValue.
+	bool Initialize(ID3D12Device5* device, ID3D12DescriptorHeap* heap, uint32 firstDescriptor, uint32 descriptorCount, uint32 frameCount, ID3D12Fence* fence);
+	void CleanUp();
+
+	// Returns the heap index of the first descriptor of a free block. Safe from any number of threads.
+	// Blocks until the oldest frame in flight retires when every block is held.
+	uint32 ReserveBlock();
+	// Marks where the blocks of the frame just recorded end. Call after recording, before the frame's fence.
+	void EndFrame(uint32 frameIdx);
+	// The fence value frameIdx signals once its command lists are executed.
+	inline void SetFrameFenceValue(uint32 frameIdx, uint64 fenceValue) { m_frameFenceValues[frameIdx] = fenceValue; }
+	// Frees the blocks of frameIdx. Call once the GPU passed its fence.
+	void Retire(uint32 frameIdx);
+
+	D3D12_CPU_DESCRIPTOR_HANDLE GetCpuHandle(uint32 descriptorIdx);
+	D3D12_GPU_DESCRIPTOR_HANDLE GetGpuHandle(uint32 descriptorIdx);
+	// Source of the descriptor copied to descriptorIdx. Only the thread owning the block writes it.
+	inline void SetSourceHandle(uint32 descriptorIdx, SIZE_T srcHandle) { m_srcHandles[descriptorIdx - m_firstDescriptor] = srcHandle; }
+	inline SIZE_T GetSourceHandle(uint32 descriptorIdx) { return m_srcHandles[descriptorIdx - m_firstDescriptor]; }
+
+	inline ID3D12DescriptorHeap* GetDescriptorHeap() { return m_descriptorHeap; }
+	inline uint32 GetTypeSize() { return m_typeSize; }
+	inline uint32 GetCapacity() { return m_blockCount * BLOCK_SIZE; }
+	// Descriptors in blocks not yet retired, and the most there were when a frame ended.
+	uint32 GetReservedCount();
+	inline uint32 GetHighWaterMark() { return m_highWaterMark; }
+	// Times a thread had to wait for the GPU to get a block.
+	inline uint32 GetWaitCount() { return static_cast<uint32>(m_waitCount); }
+
+private:
+	void WaitForOldestFrame();
+
+private:
+	ID3D12DescriptorHeap* m_descriptorHeap = nullptr;
+	D3D12_CPU_DESCRIPTOR_HANDLE m_cpuHeapStart = {};
+	D3D12_GPU_DESCRIPTOR_HANDLE m_gpuHeapStart = {};
+	SIZE_T* m_srcHandles = nullptr;
+	uint64* m_frameEnds = nullptr;
+	uint64* m_frameFenceValues = nullptr;
+	ID3D12Fence* m_fence = nullptr;
+	HANDLE m_fenceEvent = nullptr;
+	std::mutex m_retireMutex;
+	uint32 m_frameCount = 0;
+	uint32 m_firstDescriptor = 0;
+	uint32 m_blockCount = 0;
+	uint32 m_typeSize = 0;
+	uint32 m_highWaterMark = 0;
+	volatile long long m_head = 0;		// blocks ever reserved
+	volatile long long m_tail = 0;		// blocks ever retired, only moves under m_retireMutex
+	volatile long m_waitCount = 0;
+};
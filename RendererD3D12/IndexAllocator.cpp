@@ -0,0 +1,232 @@
+#include "pch.h"
+#include "IndexAllocator.h"
+
+/*
+=================
+IndexAllocator
+=================
+*/
+
+static uint32 FindFirstBit(uint64 bits)
+{
+#if defined(_MSC_VER)
+	unsigned long bitIdx = 0;
+	_BitScanForward64(&bitIdx, bits);
+	return static_cast<uint32>(bitIdx);
+#else
+	return static_cast<uint32>(__builtin_ctzll(bits));
+#endif
+}
+
+IndexAllocator::IndexAllocator()
+{
+}
+
+IndexAllocator::~IndexAllocator()
+{
+	CleanUp();
+}
+
+bool IndexAllocator::Initialize(uint32 capacity)
+{
+	if (capacity == 0 || capacity > MAX_CAPACITY)
+	{
+		__debugbreak();
+		return false;
+	}
+
+	m_capacity = capacity;
+	m_wordCount = (capacity + 63) / 64;
+	m_summaryWordCount = (m_wordCount + 63) / 64;
+	m_allocatedCount = 0;
+	m_highWaterMark = 0;
+	m_failedAllocCount = 0;
+	m_staleFreeCount = 0;
+
+	m_freeBits = new uint64[m_wordCount];
+	m_summaryBits = new uint64[m_summaryWordCount];
+	m_generations = new uint16[capacity];
+	memset(m_freeBits, 0, sizeof(uint64) * m_wordCount);
+	memset(m_summaryBits, 0, sizeof(uint64) * m_summaryWordCount);
+	memset(m_generations, 0, sizeof(uint16) * capacity);
+
+	SetFree(0, capacity);
+
+	return true;
+}
+
+void IndexAllocator::CleanUp()
+{
+	if (m_freeBits)
+	{
+		delete[] m_freeBits;
+		m_freeBits = nullptr;
+	}
+	if (m_summaryBits)
+	{
+		delete[] m_summaryBits;
+		m_summaryBits = nullptr;
+	}
+	if (m_generations)
+	{
+		delete[] m_generations;
+		m_generations = nullptr;
+	}
+	m_capacity = 0;
+	m_allocatedCount = 0;
+}
+
+uint32 IndexAllocator::Alloc()
+{
+	// The summary finds a word with a free bit without walking the words, one scan per 4096 indices.
+	for (uint32 i = 0; i < m_summaryWordCount; i++)
+	{
+		if (m_summaryBits[i])
+		{
+			uint32 wordIdx = i * 64 + FindFirstBit(m_summaryBits[i]);
+			uint32 index = wordIdx * 64 + FindFirstBit(m_freeBits[wordIdx]);
+
+			SetAllocated(index, 1);
+
+			return MakeHandle(index);
+		}
+	}
+
+	m_failedAllocCount++;
+
+	return INVALID_HANDLE;
+}
+
+uint32 IndexAllocator::AllocRange(uint32 count)
+{
+	if (count == 1)
+	{
+		return Alloc();
+	}
+
+	uint32 runBegin = 0;
+	uint32 runLength = 0;
+	uint32 index = 0;
+	while (count && index < m_capacity)
+	{
+		// Skip whole words that are full.
+		if ((index & 63) == 0 && m_freeBits[index / 64] == 0)
+		{
+			runLength = 0;
+			index += 64;
+			continue;
+		}
+
+		if (IsFree(index))
+		{
+			if (runLength == 0)
+			{
+				runBegin = index;
+			}
+			runLength++;
+
+			if (runLength == count)
+			{
+				SetAllocated(runBegin, count);
+
+				return MakeHandle(runBegin);
+			}
+		}
+		else
+		{
+			runLength = 0;
+		}
+		index++;
+	}
+
+	m_failedAllocCount++;
+
+	return INVALID_HANDLE;
+}
+
+bool IndexAllocator::Free(uint32 handle)
+{
+	return FreeRange(handle, 1);
+}
+
+bool IndexAllocator::FreeRange(uint32 handle, uint32 count)
+{
+	uint32 index = GetIndex(handle);
+	if (!IsValid(handle) || count == 0 || index + count > m_capacity)
+	{
+		m_staleFreeCount++;
+		return false;
+	}
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		if (IsFree(index + i))
+		{
+			m_staleFreeCount++;
+			return false;
+		}
+	}
+
+	// A new generation turns every handle still pointing at these indices stale.
+	for (uint32 i = 0; i < count; i++)
+	{
+		m_generations[index + i] = static_cast<uint16>((m_generations[index + i] + 1) & GENERATION_MASK);
+	}
+
+	SetFree(index, count);
+
+	return true;
+}
+
+bool IndexAllocator::IsValid(uint32 handle)
+{
+	uint32 index = GetIndex(handle);
+	if (handle == INVALID_HANDLE || index >= m_capacity)
+	{
+		return false;
+	}
+
+	return !IsFree(index) && m_generations[index] == GetGeneration(handle);
+}
+
+bool IndexAllocator::IsFree(uint32 index)
+{
+	return (m_freeBits[index / 64] >> (index & 63)) & 1;
+}
+
+void IndexAllocator::SetAllocated(uint32 index, uint32 count)
+{
+	for (uint32 i = index; i < index + count; i++)
+	{
+		uint32 wordIdx = i / 64;
+		m_freeBits[wordIdx] &= ~(1ull << (i & 63));
+		if (m_freeBits[wordIdx] == 0)
+		{
+			m_summaryBits[wordIdx / 64] &= ~(1ull << (wordIdx & 63));
+		}
+	}
+
+	m_allocatedCount += count;
+	if (m_allocatedCount > m_highWaterMark)
+	{
+		m_highWaterMark = m_allocatedCount;
+	}
+}
+
+void IndexAllocator::SetFree(uint32 index, uint32 count)
+{
+	for (uint32 i = index; i < index + count; i++)
+	{
+		uint32 wordIdx = i / 64;
+		m_freeBits[wordIdx] |= 1ull << (i & 63);
+		m_summaryBits[wordIdx / 64] |= 1ull << (wordIdx & 63);
+	}
+
+	// Initialize marks the whole table free without anything allocated.
+	m_allocatedCount = m_allocatedCount > count ? m_allocatedCount - count : 0;
+}
+
+uint32 IndexAllocator::MakeHandle(uint32 index)
+{
+	return (static_cast<uint32>(m_generations[index]) << INDEX_BITS) | index;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+=================
+IndexAllocator
+=================
+*/
+
+// Hands out indices of a fixed size table as generation checked handles. Holds no resources,
+// so the same math serves any heap or table. Not thread safe.
+class IndexAllocator
+{
+public:
+	static const uint32 INDEX_BITS = 20;
+	static const uint32 INDEX_MASK = (1 << INDEX_BITS) - 1;
+	static const uint32 GENERATION_MASK = (1 << (32 - INDEX_BITS)) - 1;
+	static const uint32 MAX_CAPACITY = INDEX_MASK;		// the all ones index is never handed out
+	static const uint32 INVALID_HANDLE = 0xffffffff;
+
+	static inline uint32 GetIndex(uint32 handle) { return handle & INDEX_MASK; }
+	static inline uint32 GetGeneration(uint32 handle) { return handle >> INDEX_BITS; }
+
+	IndexAllocator();
+	~IndexAllocator();
+
+	bool Initialize(uint32 capacity);
+	void CleanUp();
+
+	// Lowest free index. Returns INVALID_HANDLE when the table is full.
+	uint32 Alloc();
+	// count consecutive indices, the handle names the first one. Returns INVALID_HANDLE when no free run is long enough.
+	uint32 AllocRange(uint32 count);
+	// Returns false and frees nothing when handle is stale, which is how a double free or a use after free shows up.
+	bool Free(uint32 handle);
+	bool FreeRange(uint32 handle, uint32 count);
+	bool IsValid(uint32 handle);
+
+	inline uint32 GetCapacity() { return m_capacity; }
+	inline uint32 GetAllocatedCount() { return m_allocatedCount; }
+	inline uint32 GetHighWaterMark() { return m_highWaterMark; }
+	inline uint32 GetFailedAllocCount() { return m_failedAllocCount; }
+	inline uint32 GetStaleFreeCount() { return m_staleFreeCount; }
+
+private:
+	bool IsFree(uint32 index);
+	void SetAllocated(uint32 index, uint32 count);
+	void SetFree(uint32 index, uint32 count);
+	uint32 MakeHandle(uint32 index);
+
+private:
+	uint64* m_freeBits = nullptr;		// one bit per index, set while free
+	uint64* m_summaryBits = nullptr;	// one bit per m_freeBits word, set while the word has a free bit
+	uint16* m_generations = nullptr;
+	uint32 m_capacity = 0;
+	uint32 m_wordCount = 0;
+	uint32 m_summaryWordCount = 0;
+	uint32 m_allocatedCount = 0;
+	uint32 m_highWaterMark = 0;
+	uint32 m_failedAllocCount = 0;
+	uint32 m_staleFreeCount = 0;
+};
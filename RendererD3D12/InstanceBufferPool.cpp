@@ -0,0 +1,64 @@
+#include "pch.h"
+#include "InstanceBufferPool.h"
+
+/*
+===================
+InstanceBufferPool
+===================
+*/
+
+InstanceBufferPool::InstanceBufferPool()
+{
+}
+
+InstanceBufferPool::~InstanceBufferPool()
+{
+	CleanUp();
+}
+
+bool InstanceBufferPool::Initialize(ID3D12Device5* device, uint32 maxSize)
+{
+	m_allocatedSize = 0;
+	m_maxSize = maxSize;
+
+	ThrowIfFailed(device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE, &CD3DX12_RESOURCE_DESC::Buffer(maxSize), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&m_bufferResource)));
+
+	CD3DX12_RANGE writeRange(0, 0);		// We do not intend to read from this resource on the CPU.
+	m_bufferResource->Map(0, &writeRange, reinterpret_cast<void**>(&m_sysMemArr));
+
+	return true;
+}
+
+void InstanceBufferPool::CleanUp()
+{
+	if (m_bufferResource)
+	{
+		m_bufferResource->Release();
+		m_bufferResource = nullptr;
+	}
+	m_sysMemArr = nullptr;
+}
+
+uint8* InstanceBufferPool::Alloc(uint32 numElement, uint32 stride, D3D12_VERTEX_BUFFER_VIEW* vbView)
+{
+	// Keep every allocation aligned to its own stride.
+	uint32 offset = (m_allocatedSize + stride - 1) / stride * stride;
+	uint32 size = numElement * stride;
+	if (offset + size > m_maxSize)
+	{
+		return nullptr;
+	}
+
+	m_allocatedSize = offset + size;
+
+	vbView->BufferLocation = m_bufferResource->GetGPUVirtualAddress() + offset;
+	vbView->SizeInBytes = size;
+	vbView->StrideInBytes = stride;
+
+	return m_sysMemArr + offset;
+}
+
+void InstanceBufferPool::Free()
+{
+	m_allocatedSize = 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+===================
+InstanceBufferPool
+===================
+*/
+
+// Per frame upload buffer that batched draws stream their per instance or per vertex data into.
+class InstanceBufferPool
+{
+public:
+	InstanceBufferPool();
+	~InstanceBufferPool();
+
+	bool Initialize(ID3D12Device5* device, uint32 maxSize);
+	void CleanUp();
+
+	// Returns nullptr when the frame's budget is used up, callers fall back to single draws.
+	uint8* Alloc(uint32 numElement, uint32 stride, D3D12_VERTEX_BUFFER_VIEW* vbView);
+	void Free();
+
+private:
+	ID3D12Resource* m_bufferResource = nullptr;
+	uint8* m_sysMemArr = nullptr;
+	uint32 m_allocatedSize = 0;
+	uint32 m_maxSize = 0;
+};
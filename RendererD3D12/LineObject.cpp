@@ -2,9 +2,10 @@
 #include "LineObject.h"
 #include "Renderer.h"
 #include "ResourceManager.h"
-#include "DescriptorPool.h"
 #include "ConstantBufferPool.h"
-#include "ConstantBufferManager.h"
+#include "ConstantWriter.h"
+#include "PersistentConstantPool.h"
+#include "CommandListState.h"
 
 /*
 ================
@@ -12,9 +13,11 @@ LineObject
 ================
 */
 
+uint32 LineObject::sm_lastLineId;
 uint32 LineObject::sm_initRefCount;
 ID3D12RootSignature* LineObject::sm_rootSignature;
 ID3D12PipelineState* LineObject::sm_pipelineState;
+ID3D12PipelineState* LineObject::sm_frameConstPipelineState;
 
 LineObject::LineObject()
 {
@@ -29,6 +32,7 @@ LineObject::~LineObject()
 bool LineObject::Initialize(Renderer* renderer)
 {
 	m_renderer = renderer;
+	m_lineId = ++sm_lastLineId;
 
 	bool result = true;
 	if (sm_initRefCount == 0)
@@ -41,18 +45,48 @@ bool LineObject::Initialize(Renderer* renderer)
 	return result;
 }
 
-void LineObject::Draw(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, Matrix worldRow)
+void LineObject::Draw(CommandListState* cmdState, uint32 threadIdx, Matrix worldRow)
 {
-	ID3D12Device5* device = m_renderer->GetDevice();
-	ConstantBufferManager* cbManager = m_renderer->GetConstantBufferManager(threadIdx);
-	ConstantBufferPool* cbPool = cbManager->GetConstantBufferPool(CONSTANT_BUFFER_TYPE::MESH_CONST_TYPE);
-	DescriptorPool* descPool = m_renderer->GetDescriptorPool(threadIdx);
-	ID3D12DescriptorHeap* descHeap = descPool->GetDesciptorHeap();
-
-	MESH_CONST_DATA constData = {};
-	ConstantBuffer* constantBuffer = cbPool->Alloc();
-	if (constantBuffer)
+	ID3D12GraphicsCommandList* cmdList = cmdState->GetCommandList();
+	ConstantBufferPool* cbPool = m_renderer->GetConstantBufferPool(threadIdx);
+
+	D3D12_GPU_VIRTUAL_ADDRESS cbAddr = 0;
+	// Pairs with the release store in SetPersistentConstants, the slot's contents are visible once its pointer is.
+	PERSISTENT_CONSTANT_SLOT* persistentSlot = m_persistentSlot.load(std::memory_order_acquire);
+	if (sm_frameConstPipelineState && persistentSlot && PersistentConstantPool::Claim(persistentSlot, m_renderer->GetRecordFrameCount()))
+	{
+		bool hit = false;
+		cbAddr = PersistentConstantPool::Update(persistentSlot, m_renderer->GetFramePendingIdx(), worldRow, &hit);
+		if (hit)
+		{
+			cbPool->CountPersistentHit();
+		}
+		else
+		{
+			cbPool->CountPersistentMiss();
+		}
+	}
+	else if (sm_frameConstPipelineState)
+	{
+		uint8* cbPtr = cbPool->Alloc(sizeof(OBJECT_CONST_DATA), &cbAddr);
+		if (!cbPtr)
+		{
+			__debugbreak();
+		}
+
+		OBJECT_CONST_DATA constData = {};
+		constData.world = worldRow.Transpose();
+		ConstantWriter::Write(cbPtr, &constData, sizeof(OBJECT_CONST_DATA));
+	}
+	else
 	{
+		MESH_CONST_DATA constData = {};
+		uint8* cbPtr = cbPool->Alloc(sizeof(MESH_CONST_DATA), &cbAddr);
+		if (!cbPtr)
+		{
+			__debugbreak();
+		}
+
 		Matrix viewMat, projMat;
 		m_renderer->GetViewProjMatrix(&viewMat, &projMat);
 
@@ -60,25 +94,39 @@ void LineObject::Draw(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, Matr
 		constData.view = viewMat;
 		constData.projection = projMat;
 
-		memcpy(constantBuffer->sysMemAddr, &constData, sizeof(MESH_CONST_DATA));
+		ConstantWriter::Write(cbPtr, &constData, sizeof(MESH_CONST_DATA));
 	}
 
-	CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle = {};
-	CD3DX12_GPU_DESCRIPTOR_HANDLE gpuHandle = {};
-	descPool->Alloc(&cpuHandle, &gpuHandle, DESCRIPTOR_COUNT_PER_OBJ);
-
-	cmdList->SetGraphicsRootSignature(sm_rootSignature);
-	cmdList->SetPipelineState(sm_pipelineState);
-	cmdList->SetDescriptorHeaps(1, &descHeap);
+	cmdState->SetRootSignature(sm_rootSignature);
+	cmdState->SetPipelineState(sm_frameConstPipelineState ? sm_frameConstPipelineState : sm_pipelineState);
 
-	device->CopyDescriptorsSimple(1, cpuHandle, constantBuffer->cbvCpuHandle, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-	cmdList->SetGraphicsRootDescriptorTable(0, gpuHandle);
-	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
-	cmdList->IASetVertexBuffers(0, 1, &m_vbView);
+	cmdList->SetGraphicsRootConstantBufferView(0, cbAddr);
+	if (sm_frameConstPipelineState)
+	{
+		cmdList->SetGraphicsRootConstantBufferView(1, m_renderer->GetFrameConstantBufferAddress());
+	}
+	cmdState->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
+	cmdState->SetVertexBuffer(&m_vbView);
 	cmdList->DrawInstanced(m_numVertices, 1, 0, 0);
 }
 
+void LineObject::SetPersistentConstants(bool enable)
+{
+	PersistentConstantPool* persistentPool = m_renderer->GetPersistentConstantPool();
+	PERSISTENT_CONSTANT_SLOT* persistentSlot = m_persistentSlot.load(std::memory_order_relaxed);
+	if (enable && !persistentSlot)
+	{
+		m_persistentSlot.store(persistentPool->Alloc(), std::memory_order_release);
+	}
+	else if (!enable && persistentSlot)
+	{
+		m_persistentSlot.store(nullptr, std::memory_order_release);
+		// The frame thread and the frames in flight may still read the slot.
+		m_renderer->GpuCompleted();
+		persistentPool->Free(persistentSlot);
+	}
+}
+
 void LineObject::CreateLineBuffers(LineData* lineData)
 {
 	ResourceManager* resourceManager = m_renderer->GetReourceManager();
@@ -121,6 +169,12 @@ void LineObject::CleanUp()
 {
 	m_renderer->GpuCompleted();
 
+	PERSISTENT_CONSTANT_SLOT* persistentSlot = m_persistentSlot.exchange(nullptr, std::memory_order_relaxed);
+	if (persistentSlot)
+	{
+		m_renderer->GetPersistentConstantPool()->Free(persistentSlot);
+	}
+
 	uint32 refCount = --sm_initRefCount;
 	if (refCount == 0)
 	{
@@ -154,11 +208,9 @@ void LineObject::CreateRootSignature()
 	ID3DBlob* signature = nullptr;
 	ID3DBlob* error = nullptr;
 
-	CD3DX12_DESCRIPTOR_RANGE rangesPerObj[1] = {};
-	rangesPerObj[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0); // b0 
-
 	CD3DX12_ROOT_PARAMETER rootParameters[2] = {};
-	rootParameters[0].InitAsDescriptorTable(_countof(rangesPerObj), rangesPerObj, D3D12_SHADER_VISIBILITY_ALL);
+	rootParameters[0].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL); // b0
+	rootParameters[1].InitAsConstantBufferView(1, 0, D3D12_SHADER_VISIBILITY_ALL); // b1, frame constants
 
 	D3D12_STATIC_SAMPLER_DESC samplterDesc = {};
 	//pOutSamperDesc->Filter = D3D12_FILTER_ANISOTROPIC;
@@ -268,6 +320,16 @@ void LineObject::CreatePipelineState()
 		vertexShader->Release();
 		vertexShader = nullptr;
 	}
+
+	// Optional. VSMainFrameConst reads OBJECT_CONST_DATA at b0 and FRAME_CONST_DATA at b1.
+	if (D3DUtils::CompileOptionalShader(L"../../Shader/LineShader.hlsl", "VSMainFrameConst", "vs_5_0", compileFlags, &vertexShader))
+	{
+		psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader->GetBufferPointer(), vertexShader->GetBufferSize());
+		ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&sm_frameConstPipelineState)));
+
+		vertexShader->Release();
+		vertexShader = nullptr;
+	}
 	if (pixelShader)
 	{
 		pixelShader->Release();
@@ -292,6 +354,11 @@ void LineObject::DestroyRootSignature()
 
 void LineObject::DestroyPipelineState()
 {
+	if (sm_frameConstPipelineState)
+	{
+		sm_frameConstPipelineState->Release();
+		sm_frameConstPipelineState = nullptr;
+	}
 	if (sm_pipelineState)
 	{
 		sm_pipelineState->Release();
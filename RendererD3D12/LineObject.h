@@ -9,19 +9,21 @@ LineObject
 */
 
 class Renderer;
+class CommandListState;
+struct PERSISTENT_CONSTANT_SLOT;
 
 class LineObject : public IT_LineObject
 {
 public:
-	static const uint32 DESCRIPTOR_COUNT_PER_OBJ = 1;		// CB(b0)
-	// static const uint32 DESCRIPTOR_COUNT_PER_MESH_DATA = 1; // SRV(t0)
-
 	LineObject();
 	~LineObject();
 
 	/*DLL Inner*/
 	bool Initialize(Renderer* renderer);
-	void Draw(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, Matrix worldRow);
+	void Draw(CommandListState* cmdState, uint32 threadIdx, Matrix worldRow);
+	// Same as MeshObject::SetPersistentConstants.
+	void SetPersistentConstants(bool enable);
+	inline uint32 GetLineId() { return m_lineId; }
 
 	/*Interface*/
 	virtual void CreateLineBuffers(LineData* lineData) override;
@@ -39,14 +41,18 @@ private:
 	void DestroyPipelineState();
 
 private:
+	static uint32 sm_lastLineId;
 	static uint32 sm_initRefCount;
 	static ID3D12RootSignature* sm_rootSignature;
 	static ID3D12PipelineState* sm_pipelineState;
+	static ID3D12PipelineState* sm_frameConstPipelineState;
 	D3D12_VERTEX_BUFFER_VIEW m_vbView = {};
 	ID3D12Resource* m_vertexBuffer = nullptr;
 	MESH_CONST_DATA m_constData = {};
+	std::atomic<PERSISTENT_CONSTANT_SLOT*> m_persistentSlot = { nullptr };
 	Renderer* m_renderer = nullptr;
 	uint32 m_refCount = 0;
+	uint32 m_lineId = 0;
 	uint32 m_numVertices = 0;
 };
 
@@ -3,9 +3,12 @@
 #include "Renderer.h"
 #include "ResourceManager.h"
 #include "ConstantBufferPool.h"
-#include "ConstantBufferManager.h"
+#include "ConstantWriter.h"
+#include "PersistentConstantPool.h"
+#include "InstanceBufferPool.h"
 #include "DescriptorAllocator.h"
 #include "DescriptorPool.h"
+#include "CommandListState.h"
 
 /*
 ================
@@ -17,6 +20,12 @@ uint32 MeshObject::sm_initRefCount;
 ID3D12RootSignature* MeshObject::sm_rootSignature;
 ID3D12PipelineState* MeshObject::sm_defaultPSO;
 ID3D12PipelineState* MeshObject::sm_wirePSO;
+ID3D12PipelineState* MeshObject::sm_instancedPSO;
+ID3D12PipelineState* MeshObject::sm_instancedWirePSO;
+ID3D12PipelineState* MeshObject::sm_frameConstPSO;
+ID3D12PipelineState* MeshObject::sm_frameConstWirePSO;
+bool MeshObject::sm_bindlessTextures;
+uint32 MeshObject::sm_lastMeshId;
 
 MeshObject::MeshObject()
 {
@@ -31,6 +40,7 @@ MeshObject::~MeshObject()
 bool MeshObject::Initialize(Renderer* renderer)
 {
 	m_renderer = renderer;
+	m_meshId = ++sm_lastMeshId;
 
 	bool result = true;
 	if (sm_initRefCount == 0)
@@ -43,18 +53,115 @@ bool MeshObject::Initialize(Renderer* renderer)
 	return result;
 }
 
-void MeshObject::Draw(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, Matrix worldRow, bool isWire)
+void MeshObject::Draw(CommandListState* cmdState, uint32 threadIdx, Matrix worldRow, bool isWire)
 {
-	ID3D12Device5* device = m_renderer->GetDevice();
-	ConstantBufferManager* cbManager = m_renderer->GetConstantBufferManager(threadIdx);
-	ConstantBufferPool* cbPool = cbManager->GetConstantBufferPool(CONSTANT_BUFFER_TYPE::MESH_CONST_TYPE);
-	DescriptorPool* descPool = m_renderer->GetDescriptorPool(threadIdx);
-	ID3D12DescriptorHeap* descHeap = descPool->GetDesciptorHeap();
+	ID3D12GraphicsCommandList* cmdList = cmdState->GetCommandList();
+	ConstantBufferPool* cbPool = m_renderer->GetConstantBufferPool(threadIdx);
+
+	D3D12_GPU_VIRTUAL_ADDRESS cbAddr = 0;
+	ID3D12PipelineState* pipelineState = nullptr;
+	// Pairs with the release store in SetPersistentConstants, the slot's contents are visible once its pointer is.
+	PERSISTENT_CONSTANT_SLOT* persistentSlot = m_persistentSlot.load(std::memory_order_acquire);
+	if (sm_frameConstPSO && persistentSlot && PersistentConstantPool::Claim(persistentSlot, m_renderer->GetRecordFrameCount()))
+	{
+		bool hit = false;
+		cbAddr = PersistentConstantPool::Update(persistentSlot, m_renderer->GetFramePendingIdx(), worldRow, &hit);
+		if (hit)
+		{
+			cbPool->CountPersistentHit();
+		}
+		else
+		{
+			cbPool->CountPersistentMiss();
+		}
+		pipelineState = isWire ? sm_frameConstWirePSO : sm_frameConstPSO;
+	}
+	else if (sm_frameConstPSO)
+	{
+		// Only the world matrix per draw, the camera comes from the frame's constants at b1.
+		uint8* cbPtr = cbPool->Alloc(sizeof(OBJECT_CONST_DATA), &cbAddr);
+		if (!cbPtr)
+		{
+			__debugbreak();
+		}
 
-	ConstantBuffer* cb = cbPool->Alloc();
-	MESH_CONST_DATA cbData = {};
+		OBJECT_CONST_DATA cbData = {};
+		cbData.world = worldRow.Transpose();
+		ConstantWriter::Write(cbPtr, &cbData, sizeof(OBJECT_CONST_DATA));
+		pipelineState = isWire ? sm_frameConstWirePSO : sm_frameConstPSO;
+	}
+	else
+	{
+		uint8* cbPtr = cbPool->Alloc(sizeof(MESH_CONST_DATA), &cbAddr);
+		MESH_CONST_DATA cbData = {};
+
+		if (!cbPtr)
+		{
+			__debugbreak();
+		}
 
-	if (!cb)
+		Matrix viewMat, projMat;
+		m_renderer->GetViewProjMatrix(&viewMat, &projMat);
+
+		cbData.world = worldRow.Transpose();
+		cbData.view = viewMat;
+		cbData.projection = projMat;
+
+		ConstantWriter::Write(cbPtr, &cbData, sizeof(MESH_CONST_DATA));
+		pipelineState = isWire ? sm_wirePSO : sm_defaultPSO;
+	}
+
+	cmdState->SetRootSignature(sm_rootSignature);
+	cmdState->SetPipelineState(pipelineState);
+
+	cmdList->SetGraphicsRootConstantBufferView(0, cbAddr);
+	if (sm_frameConstPSO)
+	{
+		cmdList->SetGraphicsRootConstantBufferView(2, m_renderer->GetFrameConstantBufferAddress());
+	}
+
+	DrawMeshes(cmdState, threadIdx, 1);
+}
+
+void MeshObject::SetPersistentConstants(bool enable)
+{
+	PersistentConstantPool* persistentPool = m_renderer->GetPersistentConstantPool();
+	PERSISTENT_CONSTANT_SLOT* persistentSlot = m_persistentSlot.load(std::memory_order_relaxed);
+	if (enable && !persistentSlot)
+	{
+		m_persistentSlot.store(persistentPool->Alloc(), std::memory_order_release);
+	}
+	else if (!enable && persistentSlot)
+	{
+		m_persistentSlot.store(nullptr, std::memory_order_release);
+		// The frame thread and the frames in flight may still read the slot.
+		m_renderer->GpuCompleted();
+		persistentPool->Free(persistentSlot);
+	}
+}
+
+bool MeshObject::DrawInstanced(CommandListState* cmdState, uint32 threadIdx, const Matrix* const* worldRows, uint32 instanceCount, bool isWire)
+{
+	ID3D12GraphicsCommandList* cmdList = cmdState->GetCommandList();
+	ConstantBufferPool* cbPool = m_renderer->GetConstantBufferPool(threadIdx);
+	InstanceBufferPool* instancePool = m_renderer->GetInstanceBufferPool(threadIdx);
+
+	D3D12_VERTEX_BUFFER_VIEW instanceBufferView = {};
+	Matrix* instanceData = reinterpret_cast<Matrix*>(instancePool->Alloc(instanceCount, sizeof(Matrix), &instanceBufferView));
+	if (!instanceData)
+	{
+		return false;
+	}
+
+	// The rows go in as WORLD0..WORLD3 vertex attributes, which the shader rebuilds row by row, so no transpose.
+	for (uint32 i = 0; i < instanceCount; i++)
+	{
+		instanceData[i] = *worldRows[i];
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS cbAddr = 0;
+	uint8* cbPtr = cbPool->Alloc(sizeof(MESH_CONST_DATA), &cbAddr);
+	if (!cbPtr)
 	{
 		__debugbreak();
 	}
@@ -62,42 +169,69 @@ void MeshObject::Draw(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, Matr
 	Matrix viewMat, projMat;
 	m_renderer->GetViewProjMatrix(&viewMat, &projMat);
 
-	cbData.world = worldRow.Transpose();
+	// One constant buffer for the whole group, the world matrix comes from the instance stream.
+	MESH_CONST_DATA cbData = {};
+	cbData.world = Matrix();
 	cbData.view = viewMat;
 	cbData.projection = projMat;
+	ConstantWriter::Write(cbPtr, &cbData, sizeof(MESH_CONST_DATA));
 
-	MESH_CONST_DATA* cbPtr = reinterpret_cast<MESH_CONST_DATA*>(cb->sysMemAddr);
+	cmdState->SetRootSignature(sm_rootSignature);
+	cmdState->SetPipelineState(isWire ? sm_instancedWirePSO : sm_instancedPSO);
 
-	cbPtr->world = cbData.world;
-	cbPtr->view = cbData.view;
-	cbPtr->projection = cbData.projection;
+	cmdList->SetGraphicsRootConstantBufferView(0, cbAddr);
 
-	CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle = {};
-	CD3DX12_GPU_DESCRIPTOR_HANDLE gpuHandle = {};
-	descPool->Alloc(&cpuHandle, &gpuHandle, DESCRIPTOR_COUNT_PER_OBJ + m_numMeshes * DESCRIPTOR_COUNT_PER_MESH_DATA);
+	cmdList->IASetVertexBuffers(1, 1, &instanceBufferView);
+
+	DrawMeshes(cmdState, threadIdx, instanceCount);
+
+	return true;
+}
+
+void MeshObject::DrawMeshes(CommandListState* cmdState, uint32 threadIdx, uint32 instanceCount)
+{
+	ID3D12GraphicsCommandList* cmdList = cmdState->GetCommandList();
+
+	if (sm_bindlessTextures)
+	{
+		// Every SRV already sits in the shader visible heap, a sub-mesh only passes the index of its slot.
+		DescriptorAllocator* descriptorAllocator = m_renderer->GetDescriptorAllocator();
+
+		cmdState->SetDescriptorHeap(descriptorAllocator->GetShaderVisibleHeap());
+		cmdList->SetGraphicsRootDescriptorTable(4, descriptorAllocator->GetShaderVisibleHeapStart());
+
+		for (uint32 i = 0; i < m_numMeshes; i++)
+		{
+			cmdList->SetGraphicsRoot32BitConstant(3, descriptorAllocator->GetShaderIndex(m_meshes[i].textureHandle->srvHandle), 0);
+			cmdState->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			cmdState->SetVertexBuffer(&m_meshes[i].vertexBufferView);
+			cmdState->SetIndexBuffer(&m_meshes[i].indexBufferView);
+			cmdList->DrawIndexedInstanced(m_meshes[i].numIndices, instanceCount, 0, 0, 0);
+		}
+		return;
+	}
 
-	cmdList->SetGraphicsRootSignature(sm_rootSignature);
-	cmdList->SetPipelineState(isWire ? sm_wirePSO : sm_defaultPSO);
-	cmdList->SetDescriptorHeaps(1, &descHeap);
+	DescriptorPool* descPool = m_renderer->GetDescriptorPool(threadIdx);
 
-	device->CopyDescriptorsSimple(1, cpuHandle, cb->cbvCpuHandle, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-	cpuHandle.Offset(1, descPool->GetTypeSize());
+	// Draws with the same textures, repeated draws of one model for a start, share one table per frame.
+	D3D12_CPU_DESCRIPTOR_HANDLE srcHandles[MAX_MESH_DATA_COUNT_PER_OBJ] = {};
 	for (uint32 i = 0; i < m_numMeshes; i++)
 	{
-		device->CopyDescriptorsSimple(1, cpuHandle, m_meshes[i].textureHandle->srv, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-		cpuHandle.Offset(1, descPool->GetTypeSize());
+		srcHandles[i] = m_meshes[i].textureHandle->srv;
 	}
 
-	cmdList->SetGraphicsRootDescriptorTable(0, gpuHandle);
-	gpuHandle.Offset(1, descPool->GetTypeSize());
+	CD3DX12_GPU_DESCRIPTOR_HANDLE gpuHandle = {};
+	descPool->AllocTable(&gpuHandle, srcHandles, m_numMeshes * DESCRIPTOR_COUNT_PER_MESH_DATA);
+
+	cmdState->SetDescriptorHeap(descPool->GetDesciptorHeap());
 
 	for (uint32 i = 0; i < m_numMeshes; i++)
 	{
 		cmdList->SetGraphicsRootDescriptorTable(1, gpuHandle);
-		cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		cmdList->IASetVertexBuffers(0, 1, &m_meshes[i].vertexBufferView);
-		cmdList->IASetIndexBuffer(&m_meshes[i].indexBufferView);
-		cmdList->DrawIndexedInstanced(m_meshes[i].numIndices, 1, 0, 0, 0);
+		cmdState->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		cmdState->SetVertexBuffer(&m_meshes[i].vertexBufferView);
+		cmdState->SetIndexBuffer(&m_meshes[i].indexBufferView);
+		cmdList->DrawIndexedInstanced(m_meshes[i].numIndices, instanceCount, 0, 0, 0);
 
 		gpuHandle.Offset(1, descPool->GetTypeSize());
 	}
@@ -187,6 +321,12 @@ void MeshObject::CleanUp()
 {
 	m_renderer->GpuCompleted();
 
+	PERSISTENT_CONSTANT_SLOT* persistentSlot = m_persistentSlot.exchange(nullptr, std::memory_order_relaxed);
+	if (persistentSlot)
+	{
+		m_renderer->GetPersistentConstantPool()->Free(persistentSlot);
+	}
+
 	if (m_meshes)
 	{
 		for (uint32 i = 0; i < m_numMeshes; i++)
@@ -246,15 +386,18 @@ void MeshObject::CreateRootSignature()
 	ID3DBlob* signature = nullptr;
 	ID3DBlob* error = nullptr;
 
-	CD3DX12_DESCRIPTOR_RANGE rangesPerObj[1] = {};
-	rangesPerObj[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0); // b0 
-
 	CD3DX12_DESCRIPTOR_RANGE rangesPerTriGroup[1] = {};
 	rangesPerTriGroup[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0); // t0
 
-	CD3DX12_ROOT_PARAMETER rootParameters[2] = {};
-	rootParameters[0].InitAsDescriptorTable(_countof(rangesPerObj), rangesPerObj, D3D12_SHADER_VISIBILITY_ALL);
+	CD3DX12_DESCRIPTOR_RANGE bindlessRanges[1] = {};
+	bindlessRanges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, Renderer::MAX_DESCRIPTOR_COUNT, 0, 1); // t0, space1
+
+	CD3DX12_ROOT_PARAMETER rootParameters[5] = {};
+	rootParameters[0].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL); // b0
 	rootParameters[1].InitAsDescriptorTable(_countof(rangesPerTriGroup), rangesPerTriGroup, D3D12_SHADER_VISIBILITY_ALL);
+	rootParameters[2].InitAsConstantBufferView(1, 0, D3D12_SHADER_VISIBILITY_ALL); // b1, frame constants
+	rootParameters[3].InitAsConstants(1, 2, 0, D3D12_SHADER_VISIBILITY_PIXEL); // b2, texture index
+	rootParameters[4].InitAsDescriptorTable(_countof(bindlessRanges), bindlessRanges, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	D3D12_STATIC_SAMPLER_DESC samplterDesc = {};
 	//pOutSamperDesc->Filter = D3D12_FILTER_ANISOTROPIC;
@@ -331,6 +474,15 @@ void MeshObject::CreatePipelineState()
 		__debugbreak();
 	}
 
+	// Optional. PSMainBindless samples the SRV array at t0, space1 with the index at b2, and replaces PSMain in every pipeline.
+	ID3DBlob* bindlessPixelShader = nullptr;
+	if (D3DUtils::CompileOptionalShader(L"../../Shader/BasicShader.hlsl", "PSMainBindless", "ps_5_1", compileFlags, &bindlessPixelShader))
+	{
+		pixelShader->Release();
+		pixelShader = bindlessPixelShader;
+		sm_bindlessTextures = true;
+	}
+
 	// Define the vertex input layout.
 	D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
 	{
@@ -368,6 +520,48 @@ void MeshObject::CreatePipelineState()
 		vertexShader->Release();
 		vertexShader = nullptr;
 	}
+
+	// The instanced pipelines are optional. Without the VSInstanced entry every mesh job is drawn on its own.
+	if (D3DUtils::CompileOptionalShader(L"../../Shader/BasicShader.hlsl", "VSInstanced", "vs_5_0", compileFlags, &vertexShader))
+	{
+		// Slot 1 streams one row major world matrix per instance.
+		D3D12_INPUT_ELEMENT_DESC instancedInputElementDescs[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,	0, 24,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+			{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+			{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+			{ "WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 }
+		};
+
+		psoDesc.InputLayout = { instancedInputElementDescs, _countof(instancedInputElementDescs) };
+		psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader->GetBufferPointer(), vertexShader->GetBufferSize());
+		psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+		ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&sm_instancedPSO)));
+
+		psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
+		ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&sm_instancedWirePSO)));
+
+		vertexShader->Release();
+		vertexShader = nullptr;
+	}
+
+	// Optional as well. VSMainFrameConst reads OBJECT_CONST_DATA at b0 and FRAME_CONST_DATA at b1.
+	if (D3DUtils::CompileOptionalShader(L"../../Shader/BasicShader.hlsl", "VSMainFrameConst", "vs_5_0", compileFlags, &vertexShader))
+	{
+		psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
+		psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader->GetBufferPointer(), vertexShader->GetBufferSize());
+		psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+		ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&sm_frameConstPSO)));
+
+		psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
+		ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&sm_frameConstWirePSO)));
+
+		vertexShader->Release();
+		vertexShader = nullptr;
+	}
 	if (pixelShader)
 	{
 		pixelShader->Release();
@@ -391,6 +585,28 @@ void MeshObject::DestroyRootSignature()
 
 void MeshObject::DestroyPipelineState()
 {
+	sm_bindlessTextures = false;
+
+	if (sm_frameConstWirePSO)
+	{
+		sm_frameConstWirePSO->Release();
+		sm_frameConstWirePSO = nullptr;
+	}
+	if (sm_frameConstPSO)
+	{
+		sm_frameConstPSO->Release();
+		sm_frameConstPSO = nullptr;
+	}
+	if (sm_instancedWirePSO)
+	{
+		sm_instancedWirePSO->Release();
+		sm_instancedWirePSO = nullptr;
+	}
+	if (sm_instancedPSO)
+	{
+		sm_instancedPSO->Release();
+		sm_instancedPSO = nullptr;
+	}
 	if (sm_wirePSO)
 	{
 		sm_wirePSO->Release();
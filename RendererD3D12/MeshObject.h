@@ -9,21 +9,32 @@ Mesh Object
 */
 
 class Renderer;
+class CommandListState;
+struct PERSISTENT_CONSTANT_SLOT;
 
 class MeshObject : public IT_MeshObject
 {
 public:
-	static const uint32 DESCRIPTOR_COUNT_PER_OBJ = 1;		// CB(b0)
-	static const uint32 DESCRIPTOR_COUNT_PER_MESH_DATA = 1; // SRV(t0)
+	static const uint32 DESCRIPTOR_COUNT_PER_MESH_DATA = 1; // SRV(t0), CB(b0) is a root CBV
 	static const uint32 MAX_MESH_DATA_COUNT_PER_OBJ = 8;
-	static const uint32 MAX_DESCRIPTOR_COUNT_FOR_DRAW = DESCRIPTOR_COUNT_PER_OBJ + (DESCRIPTOR_COUNT_PER_MESH_DATA * MAX_MESH_DATA_COUNT_PER_OBJ);
+	static const uint32 MAX_DESCRIPTOR_COUNT_FOR_DRAW = DESCRIPTOR_COUNT_PER_MESH_DATA * MAX_MESH_DATA_COUNT_PER_OBJ;
+
+	static inline bool IsInstancingSupported() { return sm_instancedPSO != nullptr; }
+	static inline bool IsBindlessTexturesSupported() { return sm_bindlessTextures; }
 
 	MeshObject();
 	~MeshObject();
 
 	/*DLL Inner*/
 	bool Initialize(Renderer* renderer);
-	void Draw(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, Matrix worldRow, bool isWire = false);
+	void Draw(CommandListState* cmdState, uint32 threadIdx, Matrix worldRow, bool isWire = false);
+	// Returns false when the frame's instance buffer is full and nothing was recorded.
+	bool DrawInstanced(CommandListState* cmdState, uint32 threadIdx, const Matrix* const* worldRows, uint32 instanceCount, bool isWire = false);
+	// Opt-in for objects drawn once a frame that rarely move. Their world matrix stays in a persistent slot and is only written again when it changes.
+	// Call only from the thread that creates and releases the object, never from a thread submitting render jobs. Disabling waits for the GPU.
+	void SetPersistentConstants(bool enable);
+	inline uint32 GetMeshId() { return m_meshId; }
+	inline uint32 GetTextureId() { return (m_numMeshes && m_meshes[0].textureHandle) ? m_meshes[0].textureHandle->id : 0; }
 
 	/*Interface*/
 	virtual void CreateMeshBuffers(const MeshData* meshData, const uint32 numMeshes) override;
@@ -34,6 +45,8 @@ public:
 
 private:
 	void CleanUp();
+	// Binds each sub-mesh's texture and draws it, the root signature, pipeline and constants must already be set.
+	void DrawMeshes(CommandListState* cmdState, uint32 threadIdx, uint32 instanceCount);
 	bool InitPipeline();
 	void CleanUpPipeline();
 	void CreateRootSignature();
@@ -46,9 +59,17 @@ private:
 	static ID3D12RootSignature* sm_rootSignature;
 	static ID3D12PipelineState* sm_defaultPSO;
 	static ID3D12PipelineState* sm_wirePSO;
+	static ID3D12PipelineState* sm_instancedPSO;
+	static ID3D12PipelineState* sm_instancedWirePSO;
+	static ID3D12PipelineState* sm_frameConstPSO;
+	static ID3D12PipelineState* sm_frameConstWirePSO;
+	static bool sm_bindlessTextures;
+	static uint32 sm_lastMeshId;
 	Renderer* m_renderer = nullptr;
 	MESH* m_meshes = nullptr;
+	std::atomic<PERSISTENT_CONSTANT_SLOT*> m_persistentSlot = { nullptr };
 	uint32 m_refCount = 0;
 	uint32 m_numMeshes = 0;
+	uint32 m_meshId = 0;
 };
 
@@ -0,0 +1,132 @@
+#include "pch.h"
+#include "PersistentConstantPool.h"
+#include "ConstantWriter.h"
+
+/*
+=======================
+PersistentConstantPool
+=======================
+*/
+
+bool PersistentConstantPool::Claim(PERSISTENT_CONSTANT_SLOT* slot, uint32 frameCount)
+{
+	return _InterlockedExchange(&slot->drawFrame, static_cast<long>(frameCount)) != static_cast<long>(frameCount);
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS PersistentConstantPool::Update(PERSISTENT_CONSTANT_SLOT* slot, uint32 copyIdx, const Matrix& worldRow, bool* hit)
+{
+	if (memcmp(&slot->worldRow, &worldRow, sizeof(Matrix)))
+	{
+		slot->worldRow = worldRow;
+		slot->version++;
+	}
+
+	uint32 offset = copyIdx * COPY_SIZE;
+	*hit = slot->copyVersions[copyIdx] == slot->version;
+	if (!*hit)
+	{
+		OBJECT_CONST_DATA cbData = {};
+		cbData.world = worldRow.Transpose();
+		ConstantWriter::Write(slot->sysMemAddr + offset, &cbData, sizeof(OBJECT_CONST_DATA));
+		slot->copyVersions[copyIdx] = slot->version;
+	}
+
+	return slot->gpuMemAddr + offset;
+}
+
+PersistentConstantPool::PersistentConstantPool()
+{
+}
+
+PersistentConstantPool::~PersistentConstantPool()
+{
+	CleanUp();
+}
+
+bool PersistentConstantPool::Initialize(ID3D12Device5* device, uint32 copyCount)
+{
+	if (copyCount > PERSISTENT_CONSTANT_SLOT::MAX_COPY_COUNT)
+	{
+		__debugbreak();
+		return false;
+	}
+
+	m_device = device;
+	m_copyCount = copyCount;
+	m_slotCountPerPage = PAGE_SIZE / (COPY_SIZE * copyCount);
+
+	return true;
+}
+
+void PersistentConstantPool::CleanUp()
+{
+	while (m_pageHead)
+	{
+		PERSISTENT_CONSTANT_PAGE* page = m_pageHead;
+		m_pageHead = page->next;
+
+		page->resource->Release();
+		delete[] page->slots;
+		delete page;
+	}
+
+	m_freeSlotHead = nullptr;
+	m_pageCount = 0;
+	m_allocatedSlotCount = 0;
+}
+
+PERSISTENT_CONSTANT_SLOT* PersistentConstantPool::Alloc()
+{
+	if (!m_freeSlotHead)
+	{
+		AddPage();
+	}
+
+	PERSISTENT_CONSTANT_SLOT* slot = m_freeSlotHead;
+	m_freeSlotHead = slot->next;
+
+	// Version 1 against copies at 0, so the first draw writes every copy.
+	slot->worldRow = Matrix();
+	slot->version = 1;
+	memset(slot->copyVersions, 0, sizeof(slot->copyVersions));
+	slot->drawFrame = 0;
+	slot->next = nullptr;
+
+	m_allocatedSlotCount++;
+
+	return slot;
+}
+
+void PersistentConstantPool::Free(PERSISTENT_CONSTANT_SLOT* slot)
+{
+	slot->next = m_freeSlotHead;
+	m_freeSlotHead = slot;
+
+	m_allocatedSlotCount--;
+}
+
+void PersistentConstantPool::AddPage()
+{
+	PERSISTENT_CONSTANT_PAGE* page = new PERSISTENT_CONSTANT_PAGE;
+
+	ThrowIfFailed(m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE, &CD3DX12_RESOURCE_DESC::Buffer(PAGE_SIZE), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&page->resource)));
+
+	uint8* sysMemAddr = nullptr;
+	CD3DX12_RANGE writeRange(0, 0);		// We do not intend to read from this resource on the CPU.
+	page->resource->Map(0, &writeRange, reinterpret_cast<void**>(&sysMemAddr));
+	D3D12_GPU_VIRTUAL_ADDRESS gpuMemAddr = page->resource->GetGPUVirtualAddress();
+
+	page->slots = new PERSISTENT_CONSTANT_SLOT[m_slotCountPerPage];
+	for (uint32 i = 0; i < m_slotCountPerPage; i++)
+	{
+		uint32 offset = i * COPY_SIZE * m_copyCount;
+		page->slots[i].sysMemAddr = sysMemAddr + offset;
+		page->slots[i].gpuMemAddr = gpuMemAddr + offset;
+		page->slots[i].next = m_freeSlotHead;
+		m_freeSlotHead = &page->slots[i];
+	}
+
+	page->next = m_pageHead;
+	m_pageHead = page;
+	m_pageCount++;
+}
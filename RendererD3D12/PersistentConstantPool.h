@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+=======================
+PersistentConstantPool
+=======================
+*/
+
+// Constants of one object that outlive the frame, one copy per pending frame so a copy is never rewritten while the GPU reads it.
+struct PERSISTENT_CONSTANT_SLOT
+{
+	static const uint32 MAX_COPY_COUNT = 4;
+
+	uint8* sysMemAddr = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS gpuMemAddr = 0;
+	Matrix worldRow = Matrix();
+	uint32 version = 0;		// bumped whenever worldRow changes
+	uint32 copyVersions[MAX_COPY_COUNT] = {};
+	volatile long drawFrame = 0;
+	PERSISTENT_CONSTANT_SLOT* next = nullptr;
+};
+
+struct PERSISTENT_CONSTANT_PAGE
+{
+	ID3D12Resource* resource = nullptr;
+	PERSISTENT_CONSTANT_SLOT* slots = nullptr;
+	PERSISTENT_CONSTANT_PAGE* next = nullptr;
+};
+
+class PersistentConstantPool
+{
+public:
+	static const uint32 PAGE_SIZE = 64 * 1024;
+	static const uint32 COPY_SIZE = 256;
+
+	// Only the first draw of slot in a frame may use it. Any other draw of the object that frame takes the per frame path.
+	static bool Claim(PERSISTENT_CONSTANT_SLOT* slot, uint32 frameCount);
+	// Returns the address of copyIdx, writing worldRow into it first when it is older than the slot's version.
+	static D3D12_GPU_VIRTUAL_ADDRESS Update(PERSISTENT_CONSTANT_SLOT* slot, uint32 copyIdx, const Matrix& worldRow, bool* hit);
+
+	PersistentConstantPool();
+	~PersistentConstantPool();
+
+	bool Initialize(ID3D12Device5* device, uint32 copyCount);
+	void CleanUp();
+
+	// Alloc and Free come from the thread that creates and releases objects. Free only once the GPU is done with the slot.
+	PERSISTENT_CONSTANT_SLOT* Alloc();
+	void Free(PERSISTENT_CONSTANT_SLOT* slot);
+
+	inline uint32 GetAllocatedSlotCount() { return m_allocatedSlotCount; }
+	inline uint64 GetResidentSize() { return static_cast<uint64>(m_pageCount) * PAGE_SIZE; }
+
+private:
+	void AddPage();
+
+private:
+	ID3D12Device5* m_device = nullptr;
+	PERSISTENT_CONSTANT_PAGE* m_pageHead = nullptr;
+	PERSISTENT_CONSTANT_SLOT* m_freeSlotHead = nullptr;
+	uint32 m_copyCount = 0;
+	uint32 m_slotCountPerPage = 0;
+	uint32 m_pageCount = 0;
+	uint32 m_allocatedSlotCount = 0;
+};
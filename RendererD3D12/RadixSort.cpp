@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "RadixSort.h"
+
+/*
+=============
+RadixSort
+=============
+*/
+
+void RadixSort::Sort(uint64* keys, uint32* values, uint64* tempKeys, uint32* tempValues, uint32 count)
+{
+	if (count < 2)
+	{
+		return;
+	}
+
+	uint64 keyAnd = ~0ull;
+	uint64 keyOr = 0;
+	for (uint32 i = 0; i < count; i++)
+	{
+		keyAnd &= keys[i];
+		keyOr |= keys[i];
+	}
+
+	uint64* srcKeys = keys;
+	uint32* srcValues = values;
+	uint64* destKeys = tempKeys;
+	uint32* destValues = tempValues;
+
+	for (uint32 pass = 0; pass < PASS_COUNT; pass++)
+	{
+		if (!IsPassActive(keyAnd, keyOr, pass))
+		{
+			continue;
+		}
+
+		// A single block.
+		uint32 offsets[RADIX_SIZE] = {};
+		uint32 digitCounts[RADIX_SIZE] = {};
+		CountBlock(srcKeys, count, pass, digitCounts);
+		GetBlockOffsets(digitCounts, 1, 0, offsets);
+		ScatterBlock(srcKeys, srcValues, count, pass, offsets, destKeys, destValues);
+
+		uint64* swapKeys = srcKeys;
+		srcKeys = destKeys;
+		destKeys = swapKeys;
+
+		uint32* swapValues = srcValues;
+		srcValues = destValues;
+		destValues = swapValues;
+	}
+
+	if (srcKeys != keys)
+	{
+		memcpy(keys, srcKeys, sizeof(uint64) * count);
+		memcpy(values, srcValues, sizeof(uint32) * count);
+	}
+}
+
+bool RadixSort::IsPassActive(uint64 keyAnd, uint64 keyOr, uint32 pass)
+{
+	// Bits that differ between some keys.
+	uint64 digitMask = static_cast<uint64>(RADIX_SIZE - 1) << (pass * RADIX_BITS);
+	return ((keyAnd ^ keyOr) & digitMask) != 0;
+}
+
+void RadixSort::CountBlock(const uint64* keys, uint32 count, uint32 pass, uint32* digitCounts)
+{
+	uint32 shift = pass * RADIX_BITS;
+
+	memset(digitCounts, 0, sizeof(uint32) * RADIX_SIZE);
+	for (uint32 i = 0; i < count; i++)
+	{
+		digitCounts[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+	}
+}
+
+void RadixSort::GetBlockOffsets(const uint32* blockDigitCounts, uint32 blockCount, uint32 blockIdx, uint32* offsets)
+{
+	// Keys of a digit go after every smaller digit of all blocks, and after the same digit of the blocks before.
+	uint32 offset = 0;
+	for (uint32 digit = 0; digit < RADIX_SIZE; digit++)
+	{
+		uint32 before = 0;
+		uint32 total = 0;
+		for (uint32 block = 0; block < blockCount; block++)
+		{
+			uint32 digitCount = blockDigitCounts[block * RADIX_SIZE + digit];
+			if (block < blockIdx)
+			{
+				before += digitCount;
+			}
+			total += digitCount;
+		}
+
+		offsets[digit] = offset + before;
+		offset += total;
+	}
+}
+
+void RadixSort::ScatterBlock(const uint64* srcKeys, const uint32* srcValues, uint32 count, uint32 pass, uint32* offsets, uint64* destKeys, uint32* destValues)
+{
+	uint32 shift = pass * RADIX_BITS;
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		uint64 key = srcKeys[i];
+		uint32 destIdx = offsets[(key >> shift) & (RADIX_SIZE - 1)]++;
+		destKeys[destIdx] = key;
+		destValues[destIdx] = srcValues[i];
+	}
+}
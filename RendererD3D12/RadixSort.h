@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+=============
+RadixSort
+=============
+*/
+
+class RadixSort
+{
+public:
+	static const uint32 RADIX_BITS = 8;
+	static const uint32 RADIX_SIZE = 1 << RADIX_BITS;
+	static const uint32 PASS_COUNT = (sizeof(uint64) * 8) / RADIX_BITS;
+
+	// Stable LSD sort of 64-bit keys carrying a 32-bit value each.
+	// tempKeys/tempValues must hold count elements. The result is written back to keys/values.
+	static void Sort(uint64* keys, uint32* values, uint64* tempKeys, uint32* tempValues, uint32 count);
+
+	// The same sort split into blocks for callers spreading it over workers. For every active pass, CountBlock runs
+	// for every block, then ScatterBlock for every block. Blocks of one step may run in any order or in parallel.
+	// keyAnd and keyOr are the AND and the OR of every key. A pass is skipped when all keys share its digit.
+	static bool IsPassActive(uint64 keyAnd, uint64 keyOr, uint32 pass);
+	static void CountBlock(const uint64* keys, uint32 count, uint32 pass, uint32* digitCounts);
+	// blockDigitCounts holds RADIX_SIZE counts per block from CountBlock. Writes the first destination of every digit of blockIdx.
+	static void GetBlockOffsets(const uint32* blockDigitCounts, uint32 blockCount, uint32 blockIdx, uint32* offsets);
+	static void ScatterBlock(const uint64* srcKeys, const uint32* srcValues, uint32 count, uint32 pass, uint32* offsets, uint64* destKeys, uint32* destValues);
+};
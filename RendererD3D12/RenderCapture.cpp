@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "RenderQueue.h"
+#include "RenderCapture.h"
+#include "MeshObject.h"
+#include "SpriteObject.h"
+#include "LineObject.h"
+
+/*
+=================
+RenderCapture
+=================
+*/
+
+RenderCapture::RenderCapture()
+{
+}
+
+RenderCapture::~RenderCapture()
+{
+	CleanUp();
+}
+
+bool RenderCapture::Initialize(const wchar_t* filename)
+{
+	if (_wfopen_s(&m_file, filename, L"wb") != 0 || !m_file)
+	{
+		m_file = nullptr;
+		return false;
+	}
+
+	RENDER_CAPTURE_FILE_HEADER fileHeader = {};
+	fileHeader.magic = CAPTURE_MAGIC;
+	fileHeader.version = CAPTURE_VERSION;
+	fwrite(&fileHeader, sizeof(fileHeader), 1, m_file);
+
+	m_frameCount = 0;
+
+	return true;
+}
+
+void RenderCapture::WriteFrame(RenderQueue* renderQueue, const Matrix& viewRow, const Matrix& projRow)
+{
+	RENDER_CAPTURE_FRAME_HEADER frameHeader = {};
+	frameHeader.frameIdx = m_frameCount;
+	frameHeader.jobCount = renderQueue->GetJobCount();
+	frameHeader.viewRow = viewRow;
+	frameHeader.projRow = projRow;
+	fwrite(&frameHeader, sizeof(frameHeader), 1, m_file);
+
+	for (uint32 i = 0; i < frameHeader.jobCount; i++)
+	{
+		const RENDER_JOB* job = renderQueue->GetJob(i);
+
+		RENDER_CAPTURE_JOB captureJob = {};
+		captureJob.type = job->type;
+		captureJob.isWire = job->isWire;
+		captureJob.sortKey = renderQueue->GetJobSortKey(i);
+
+		switch (job->type)
+		{
+			case RENDER_JOB_TYPE::RENDER_MESH_OBJECT:
+			{
+				MeshObject* meshObj = reinterpret_cast<MeshObject*>(job->obj);
+				captureJob.objectId = meshObj ? meshObj->GetMeshId() : 0;
+				fwrite(&captureJob, sizeof(captureJob), 1, m_file);
+				fwrite(renderQueue->GetWorldRow(job), sizeof(Matrix), 1, m_file);
+			}
+			break;
+			case RENDER_JOB_TYPE::RENDER_SPRITE_OBJECT:
+			{
+				SpriteObject* spriteObj = reinterpret_cast<SpriteObject*>(job->obj);
+				const SPRITE_RENDER_JOB* spriteJob = renderQueue->GetSpriteJob(job);
+				TEXTURE_HANDLE* texHandle = reinterpret_cast<TEXTURE_HANDLE*>(spriteJob->texHandle);
+
+				RENDER_CAPTURE_SPRITE_JOB captureSpriteJob = {};
+				captureSpriteJob.posX = spriteJob->posX;
+				captureSpriteJob.posY = spriteJob->posY;
+				captureSpriteJob.scaleX = spriteJob->scaleX;
+				captureSpriteJob.scaleY = spriteJob->scaleY;
+				captureSpriteJob.z = spriteJob->z;
+				captureSpriteJob.hasRect = spriteJob->hasRect;
+				captureSpriteJob.rect = spriteJob->rect;
+				if (texHandle)
+				{
+					captureSpriteJob.textureId = texHandle->id;
+				}
+				else if (spriteObj)
+				{
+					captureSpriteJob.textureId = spriteObj->GetTextureId();
+				}
+
+				captureJob.objectId = spriteObj ? spriteObj->GetSpriteId() : 0;
+				fwrite(&captureJob, sizeof(captureJob), 1, m_file);
+				fwrite(&captureSpriteJob, sizeof(captureSpriteJob), 1, m_file);
+			}
+			break;
+			case RENDER_JOB_TYPE::RENDER_LINE_OBJECT:
+			{
+				LineObject* lineObj = reinterpret_cast<LineObject*>(job->obj);
+				captureJob.objectId = lineObj ? lineObj->GetLineId() : 0;
+				fwrite(&captureJob, sizeof(captureJob), 1, m_file);
+				fwrite(renderQueue->GetWorldRow(job), sizeof(Matrix), 1, m_file);
+			}
+			break;
+			default:
+				__debugbreak();
+				break;
+		}
+	}
+
+	m_frameCount++;
+}
+
+void RenderCapture::CleanUp()
+{
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
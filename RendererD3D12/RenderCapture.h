@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+=================
+RenderCapture
+=================
+*/
+
+struct RENDER_CAPTURE_FILE_HEADER
+{
+	uint32 magic = 0;
+	uint32 version = 0;
+};
+
+struct RENDER_CAPTURE_FRAME_HEADER
+{
+	uint32 frameIdx = 0;
+	uint32 jobCount = 0;
+	Matrix viewRow = Matrix();
+	Matrix projRow = Matrix();
+};
+
+// Followed by a Matrix for mesh and line jobs, or a RENDER_CAPTURE_SPRITE_JOB for sprite jobs.
+struct RENDER_CAPTURE_JOB
+{
+	RENDER_JOB_TYPE type = {};
+	bool isWire = false;
+	uint16 reserved = 0;
+	uint32 objectId = 0;
+	uint64 sortKey = 0;
+};
+
+struct RENDER_CAPTURE_SPRITE_JOB
+{
+	uint32 posX = 0;
+	uint32 posY = 0;
+	float scaleX = 1.0f;
+	float scaleY = 1.0f;
+	float z = 0.0f;
+	uint32 hasRect = 0;
+	RECT rect = {};
+	uint32 textureId = 0;
+};
+
+class RenderQueue;
+
+// Writes the jobs submitted each frame to a binary file so the frame can be fed back into a RenderQueue later.
+class RenderCapture
+{
+public:
+	static const uint32 CAPTURE_MAGIC = 0x51524a52;	// "RJRQ"
+	static const uint32 CAPTURE_VERSION = 1;
+
+	RenderCapture();
+	~RenderCapture();
+
+	bool Initialize(const wchar_t* filename);
+	// Call after every job of the frame is added and before Distribute.
+	void WriteFrame(RenderQueue* renderQueue, const Matrix& viewRow, const Matrix& projRow);
+
+	inline uint32 GetFrameCount() { return m_frameCount; }
+
+private:
+	void CleanUp();
+
+private:
+	FILE* m_file = nullptr;
+	uint32 m_frameCount = 0;
+};
@@ -4,6 +4,12 @@
 #include "SpriteObject.h"
 #include "LineObject.h"
 #include "CommandContext.h"
+#include "CommandListState.h"
+#include "DescriptorPool.h"
+#include "RadixSort.h"
+#include "WorkStealingQueue.h"
+#include "SegmentedArray.h"
+#include "ConstantWriter.h"
 
 /*
 ================
@@ -11,6 +17,56 @@ RenderQueue
 ================
 */
 
+uint64 RenderQueue::MakeSortKey(RENDER_PIPELINE_TYPE pipelineType, uint32 textureId, uint32 batchId, float depth)
+{
+	RENDER_PASS_TYPE passType = RENDER_PASS_TYPE::RENDER_PASS_OPAQUE;
+	uint32 rootSignatureId = 0;
+
+	// Pipelines sharing a root signature get the same id so they stay adjacent.
+	switch (pipelineType)
+	{
+		case RENDER_PIPELINE_TYPE::MESH_DEFAULT_PIPELINE:
+		case RENDER_PIPELINE_TYPE::MESH_WIRE_PIPELINE:
+			rootSignatureId = 0;
+			break;
+		case RENDER_PIPELINE_TYPE::LINE_PIPELINE:
+			rootSignatureId = 1;
+			break;
+		case RENDER_PIPELINE_TYPE::SPRITE_PIPELINE:
+			passType = RENDER_PASS_TYPE::RENDER_PASS_SPRITE;
+			rootSignatureId = 2;
+			break;
+		default:
+			__debugbreak();
+			break;
+	}
+
+	if (depth < 0.0f)
+	{
+		depth = 0.0f;
+	}
+	if (depth > 1.0f)
+	{
+		depth = 1.0f;
+	}
+	uint32 depthBucket = static_cast<uint32>(depth * SORT_KEY_DEPTH_MASK);
+
+	uint64 key = 0;
+	key |= static_cast<uint64>(passType) << SORT_KEY_PASS_SHIFT;
+	key |= static_cast<uint64>(rootSignatureId) << SORT_KEY_ROOT_SIGNATURE_SHIFT;
+	key |= static_cast<uint64>(pipelineType) << SORT_KEY_PSO_SHIFT;
+	if (passType == RENDER_PASS_TYPE::RENDER_PASS_SPRITE)
+	{
+		key |= static_cast<uint64>(depthBucket) << SORT_KEY_SPRITE_DEPTH_SHIFT;
+		return key;
+	}
+	key |= static_cast<uint64>(textureId & SORT_KEY_TEXTURE_MASK) << SORT_KEY_TEXTURE_SHIFT;
+	key |= static_cast<uint64>(batchId & SORT_KEY_BATCH_MASK) << SORT_KEY_BATCH_SHIFT;
+	key |= static_cast<uint64>(depthBucket) << SORT_KEY_DEPTH_SHIFT;
+
+	return key;
+}
+
 RenderQueue::RenderQueue()
 {
 }
@@ -20,54 +76,351 @@ RenderQueue::~RenderQueue()
 	CleanUp();
 }
 
-bool RenderQueue::Initialize(ID3D12Device5* device, uint32 maxNumJob)
+bool RenderQueue::Initialize(ID3D12Device5* device, uint32 initialNumJob, uint32 maxThreadCount)
 {
 	m_device = device;
-	m_maxBufferSize = sizeof(RENDER_JOB) * maxNumJob;
-	m_queueBuffer = (uint8*)malloc(m_maxBufferSize);
 
-	m_readPos = 0;
+	m_jobs = new SegmentedArray;
+	m_jobs->Initialize(sizeof(RENDER_JOB), initialNumJob);
+	m_jobSortKeys = new SegmentedArray;
+	m_jobSortKeys->Initialize(sizeof(uint64), initialNumJob);
+	m_worldRows = new SegmentedArray;
+	m_worldRows->Initialize(sizeof(Matrix), initialNumJob);
+	m_spriteJobs = new SegmentedArray;
+	m_spriteJobs->Initialize(sizeof(SPRITE_RENDER_JOB), initialNumJob);
+
+	ReserveSortBuffer(initialNumJob);
+	m_sortBlockDigitCounts = new uint32[MAX_SORT_BLOCK_COUNT * RadixSort::RADIX_SIZE];
+
+	m_maxThreadCount = maxThreadCount;
+	m_workQueues = new WorkStealingQueue[maxThreadCount];
+
+	// The list count of a frame depends on how often the threads steal, both arrays grow when a frame needs more.
+	m_recordedCmdLists = new SegmentedArray;
+	m_recordedCmdLists->Initialize(sizeof(RECORDED_COMMAND_LIST), maxThreadCount);
+	ReserveSubmitBuffer(maxThreadCount);
+
 	m_writePos = 0;
+	m_worldRowCount = 0;
+	m_spriteJobCount = 0;
 
 	return true;
 }
 
-void RenderQueue::Add(const RENDER_JOB* renderJob)
+void RenderQueue::AddMeshJob(uint64 sortKey, MeshObject* meshObj, const Matrix& worldRow, bool isWire)
 {
-	if (m_writePos >= m_maxBufferSize)
-	{
-		__debugbreak();
-	}
+	RENDER_JOB job = {};
+	job.type = RENDER_JOB_TYPE::RENDER_MESH_OBJECT;
+	job.isWire = isWire;
+	job.dataIdx = AllocData(&m_worldRowCount);
+	job.obj = meshObj;
+
+	*reinterpret_cast<Matrix*>(m_worldRows->Reserve(job.dataIdx)) = worldRow;
+	AddJob(sortKey, &job);
+}
+
+void RenderQueue::AddSpriteJob(uint64 sortKey, SpriteObject* spriteObj, const SPRITE_RENDER_JOB* spriteJob)
+{
+	RENDER_JOB job = {};
+	job.type = RENDER_JOB_TYPE::RENDER_SPRITE_OBJECT;
+	job.dataIdx = AllocData(&m_spriteJobCount);
+	job.obj = spriteObj;
+
+	*reinterpret_cast<SPRITE_RENDER_JOB*>(m_spriteJobs->Reserve(job.dataIdx)) = *spriteJob;
+	// Replayed keys come with the index they were captured with, this submission's index replaces it.
+	sortKey = (sortKey & ~SORT_KEY_SUBMIT_MASK) | job.dataIdx;
+	AddJob(sortKey, &job);
+}
 
-	uint8* dest = m_queueBuffer + m_writePos;
-	const RENDER_JOB* src = renderJob;
-	memcpy(dest, src, sizeof(RENDER_JOB));
+void RenderQueue::AddLineJob(uint64 sortKey, LineObject* lineObj, const Matrix& worldRow)
+{
+	RENDER_JOB job = {};
+	job.type = RENDER_JOB_TYPE::RENDER_LINE_OBJECT;
+	job.dataIdx = AllocData(&m_worldRowCount);
+	job.obj = lineObj;
 
-	m_writePos += sizeof(RENDER_JOB);
-	m_jobCount++;
+	*reinterpret_cast<Matrix*>(m_worldRows->Reserve(job.dataIdx)) = worldRow;
+	AddJob(sortKey, &job);
 }
 
 void RenderQueue::Free()
 {
+	// The segments stay allocated, the next frame writes over them.
+	m_frameHighWaterMark = GetJobCount();
+	if (m_frameHighWaterMark > m_highWaterMark)
+	{
+		m_highWaterMark = m_frameHighWaterMark;
+	}
+
 	m_writePos = 0;
-	m_readPos = 0;
+	m_worldRowCount = 0;
+	m_spriteJobCount = 0;
+}
+
+uint64 RenderQueue::GetSubmittedBytes()
+{
+	// Bytes written by the Add functions this frame: headers and sort keys, plus the side arrays.
+	uint64 bytes = 0;
+	bytes += static_cast<uint64>(GetJobCount()) * (sizeof(RENDER_JOB) + sizeof(uint64));
+	bytes += static_cast<uint64>(m_worldRowCount) * sizeof(Matrix);
+	bytes += static_cast<uint64>(m_spriteJobCount) * sizeof(SPRITE_RENDER_JOB);
+	return bytes;
+}
+
+uint32 RenderQueue::GetSegmentCount()
+{
+	return m_jobs->GetSegmentCount() + m_jobSortKeys->GetSegmentCount() + m_worldRows->GetSegmentCount() + m_spriteJobs->GetSegmentCount();
+}
+
+const RENDER_JOB* RenderQueue::GetJob(uint32 jobIdx)
+{
+	return reinterpret_cast<RENDER_JOB*>(m_jobs->Get(jobIdx));
 }
 
-uint32 RenderQueue::Process(uint32 threadIdx, CommandContext* cmdCtx, ID3D12CommandQueue* cmdQueue, uint32 processCountPerCmdList, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle, D3D12_VIEWPORT viewPort, D3D12_RECT scissorRect)
+uint64 RenderQueue::GetJobSortKey(uint32 jobIdx)
+{
+	return *reinterpret_cast<uint64*>(m_jobSortKeys->Get(jobIdx));
+}
+
+const Matrix* RenderQueue::GetWorldRow(const RENDER_JOB* renderJob)
+{
+	return reinterpret_cast<Matrix*>(m_worldRows->Get(renderJob->dataIdx));
+}
+
+const SPRITE_RENDER_JOB* RenderQueue::GetSpriteJob(const RENDER_JOB* renderJob)
+{
+	return reinterpret_cast<SPRITE_RENDER_JOB*>(m_spriteJobs->Get(renderJob->dataIdx));
+}
+
+void RenderQueue::Distribute(uint32 threadCount)
+{
+	uint32 gatherCount = PrepareSort();
+	for (uint32 i = 0; i < gatherCount; i++)
+	{
+		GatherSortKeys(i);
+	}
+	for (uint32 pass = 0; pass < RadixSort::PASS_COUNT; pass++)
+	{
+		for (uint32 i = 0; i < m_sortBlockCount; i++)
+		{
+			CountSortBlock(pass, i);
+		}
+		for (uint32 i = 0; i < m_sortBlockCount; i++)
+		{
+			ScatterSortBlock(pass, i);
+		}
+	}
+	SortAndSplit(threadCount);
+}
+
+uint32 RenderQueue::PrepareSort()
+{
+	uint32 jobCount = GetJobCount();
+
+	ReserveSortBuffer(jobCount);
+
+	m_sortBlockCount = (jobCount + SORT_BLOCK_SIZE - 1) / SORT_BLOCK_SIZE;
+	if (m_sortBlockCount > MAX_SORT_BLOCK_COUNT)
+	{
+		m_sortBlockCount = MAX_SORT_BLOCK_COUNT;
+	}
+	m_sortBlockSize = m_sortBlockCount ? (jobCount + m_sortBlockCount - 1) / m_sortBlockCount : 0;
+	m_sortKeyAnd = -1;
+	m_sortKeyOr = 0;
+	m_unsortedStateChangeCount = 0;
+
+	// One gather item per segment of the key array.
+	return (jobCount + SegmentedArray::SEGMENT_SIZE - 1) / SegmentedArray::SEGMENT_SIZE;
+}
+
+void RenderQueue::GatherSortKeys(uint32 gatherIdx)
+{
+	uint32 jobCount = GetJobCount();
+	uint32 beginPos = gatherIdx * SegmentedArray::SEGMENT_SIZE;
+	uint32 count = jobCount - beginPos;
+	if (count > SegmentedArray::SEGMENT_SIZE)
+	{
+		count = SegmentedArray::SEGMENT_SIZE;
+	}
+
+	// Gather the keys into one contiguous run for the radix sort.
+	memcpy(m_sortKeys + beginPos, m_jobSortKeys->Get(beginPos), sizeof(uint64) * count);
+
+	// The bits the keys share tell which radix passes can be skipped, and the unsorted state changes are counted on the way.
+	uint64 keyAnd = ~0ull;
+	uint64 keyOr = 0;
+	uint32 stateChangeCount = 0;
+	uint64 prevState = beginPos ? GetStateBits(*reinterpret_cast<uint64*>(m_jobSortKeys->Get(beginPos - 1))) : 0;
+	for (uint32 i = beginPos; i < beginPos + count; i++)
+	{
+		uint64 key = m_sortKeys[i];
+		keyAnd &= key;
+		keyOr |= key;
+
+		uint64 state = GetStateBits(key);
+		if (i == 0 || state != prevState)
+		{
+			stateChangeCount++;
+		}
+		prevState = state;
+
+		m_sortIndices[i] = i;
+	}
+
+	_InterlockedAnd64(&m_sortKeyAnd, static_cast<long long>(keyAnd));
+	_InterlockedOr64(&m_sortKeyOr, static_cast<long long>(keyOr));
+	_InterlockedExchangeAdd(&m_unsortedStateChangeCount, static_cast<long>(stateChangeCount));
+}
+
+void RenderQueue::CountSortBlock(uint32 pass, uint32 blockIdx)
+{
+	if (!IsSortPassActive(pass))
+	{
+		return;
+	}
+
+	uint64* srcKeys = nullptr;
+	uint32* srcValues = nullptr;
+	uint64* destKeys = nullptr;
+	uint32* destValues = nullptr;
+	GetSortBuffers(pass, &srcKeys, &srcValues, &destKeys, &destValues);
+
+	uint32 beginPos = 0;
+	uint32 count = 0;
+	GetSortBlockRange(blockIdx, &beginPos, &count);
+	RadixSort::CountBlock(srcKeys + beginPos, count, pass, m_sortBlockDigitCounts + blockIdx * RadixSort::RADIX_SIZE);
+}
+
+void RenderQueue::ScatterSortBlock(uint32 pass, uint32 blockIdx)
+{
+	if (!IsSortPassActive(pass))
+	{
+		return;
+	}
+
+	uint64* srcKeys = nullptr;
+	uint32* srcValues = nullptr;
+	uint64* destKeys = nullptr;
+	uint32* destValues = nullptr;
+	GetSortBuffers(pass, &srcKeys, &srcValues, &destKeys, &destValues);
+
+	uint32 beginPos = 0;
+	uint32 count = 0;
+	GetSortBlockRange(blockIdx, &beginPos, &count);
+
+	uint32 offsets[RadixSort::RADIX_SIZE] = {};
+	RadixSort::GetBlockOffsets(m_sortBlockDigitCounts, m_sortBlockCount, blockIdx, offsets);
+	RadixSort::ScatterBlock(srcKeys + beginPos, srcValues + beginPos, count, pass, offsets, destKeys, destValues);
+}
+
+void RenderQueue::SortAndSplit(uint32 threadCount)
+{
+	if (threadCount == 0 || threadCount > m_maxThreadCount)
+	{
+		__debugbreak();
+	}
+
+	// After an odd number of passes the sorted keys sit in the temp buffers.
+	uint32 activePassCount = 0;
+	for (uint32 pass = 0; pass < RadixSort::PASS_COUNT; pass++)
+	{
+		if (IsSortPassActive(pass))
+		{
+			activePassCount++;
+		}
+	}
+	if (activePassCount & 1)
+	{
+		uint64* swapKeys = m_sortKeys;
+		m_sortKeys = m_tempSortKeys;
+		m_tempSortKeys = swapKeys;
+
+		uint32* swapIndices = m_sortIndices;
+		m_sortIndices = m_tempSortIndices;
+		m_tempSortIndices = swapIndices;
+	}
+
+	m_sortedStateChangeCount = CountStateChanges(m_sortKeys);
+
+	uint32 rangeCount = (GetJobCount() + JOB_RANGE_SIZE - 1) / JOB_RANGE_SIZE;
+
+	// Contiguous blocks keep each thread on neighbouring sort keys until it starts stealing.
+	for (uint32 i = 0; i < threadCount; i++)
+	{
+		uint32 beginRange = rangeCount * i / threadCount;
+		uint32 endRange = rangeCount * (i + 1) / threadCount;
+		m_workQueues[i].Reset(beginRange, endRange);
+	}
+
+	m_workQueueCount = threadCount;
+	m_stealCount = 0;
+	m_drawCount = 0;
+}
+
+uint32 RenderQueue::Process(uint32 threadIdx, CommandContext* cmdCtx, DescriptorPool* descPool, uint32 processCountPerCmdList, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle, D3D12_VIEWPORT viewPort, D3D12_RECT scissorRect, bool stealWork)
 {
 	const RENDER_JOB* job = nullptr;
+	CommandListState* cmdState = nullptr;
 	ID3D12GraphicsCommandList* cmdList = nullptr;
-	ID3D12GraphicsCommandList* cmdLists[64] = {};
 	uint32 processCount = 0;
 	uint32 procCountPerCmdList = 0;
-	uint32 cmdListCount = 0;
+	uint32 cmdListFirstPos = 0;
+	uint32 lastJobPos = 0;
+	uint32 readPos = 0;
+	uint32 endPos = 0;
+	uint32 drawCount = 0;
+	bool instancing = MeshObject::IsInstancingSupported();
+	bool spriteBatching = SpriteObject::IsBatchingSupported();
+	MESH_INSTANCE_BATCH instanceBatch = {};
+	SPRITE_BATCH spriteBatch = {};
 
-	while (job = Dispatch())
+	if (threadIdx >= m_workQueueCount)
 	{
-		cmdList = cmdCtx->GetCurrentCommandList();
-		cmdList->RSSetViewports(1, &viewPort);
-		cmdList->RSSetScissorRects(1, &scissorRect);
-		cmdList->OMSetRenderTargets(1, &rtvHandle, false, &dsvHandle);
+		__debugbreak();
+	}
+
+	while (job = Dispatch(threadIdx, stealWork, &readPos, &endPos))
+	{
+		uint32 jobPos = readPos - 1;
+
+		// A stolen or non adjacent range starts a new list, so Submit can restore sorted order.
+		if (procCountPerCmdList && jobPos != lastJobPos + 1)
+		{
+			drawCount += FlushBatches(&instanceBatch, &spriteBatch, cmdState, threadIdx);
+
+			descPool->FlushCopies();
+			cmdCtx->Close();
+			RecordCommandList(cmdList, cmdListFirstPos);
+			cmdList = nullptr;
+			procCountPerCmdList = 0;
+		}
+		lastJobPos = jobPos;
+
+		// Draw the pending group as soon as a job can not join it.
+		if (instanceBatch.instanceCount)
+		{
+			if (job->type != RENDER_JOB_TYPE::RENDER_MESH_OBJECT || job->obj != instanceBatch.obj || job->isWire != instanceBatch.isWire || instanceBatch.instanceCount == MESH_INSTANCE_BATCH::MAX_INSTANCE_COUNT)
+			{
+				drawCount += FlushInstanceBatch(&instanceBatch, cmdState, threadIdx);
+			}
+		}
+		if (spriteBatch.spriteCount)
+		{
+			if (job->type != RENDER_JOB_TYPE::RENDER_SPRITE_OBJECT || GetSpriteTexture(job) != spriteBatch.texHandle || spriteBatch.spriteCount == SPRITE_BATCH::MAX_SPRITE_COUNT)
+			{
+				drawCount += FlushSpriteBatch(&spriteBatch, cmdState, threadIdx);
+			}
+		}
+
+		cmdState = cmdCtx->GetCurrentCommandListState();
+		cmdList = cmdState->GetCommandList();
+		cmdState->SetViewport(&viewPort);
+		cmdState->SetScissorRect(&scissorRect);
+		cmdState->SetRenderTarget(rtvHandle, dsvHandle);
+		if (procCountPerCmdList == 0)
+		{
+			cmdListFirstPos = jobPos;
+		}
 
 		switch (job->type)
 		{
@@ -79,7 +432,19 @@ uint32 RenderQueue::Process(uint32 threadIdx, CommandContext* cmdCtx, ID3D12Comm
 					__debugbreak();
 				}
 
-				meshObj->Draw(cmdList, threadIdx, job->mesh.worldRow, job->mesh.isWire);
+				const Matrix* worldRow = reinterpret_cast<Matrix*>(m_worldRows->Get(job->dataIdx));
+				if (instancing)
+				{
+					instanceBatch.obj = meshObj;
+					instanceBatch.isWire = job->isWire;
+					instanceBatch.worldRows[instanceBatch.instanceCount] = worldRow;
+					instanceBatch.instanceCount++;
+				}
+				else
+				{
+					meshObj->Draw(cmdState, threadIdx, *worldRow, job->isWire);
+					drawCount++;
+				}
 			}
 			break;
 			case RENDER_JOB_TYPE::RENDER_SPRITE_OBJECT:
@@ -89,32 +454,27 @@ uint32 RenderQueue::Process(uint32 threadIdx, CommandContext* cmdCtx, ID3D12Comm
 				{
 					__debugbreak();
 				}
-				SPRITE_RENDER_JOB param = {};
-				param.posX = job->sprite.posX;
-				param.posY = job->sprite.posY;
-				param.scaleX = job->sprite.scaleX;
-				param.scaleY = job->sprite.scaleY;
-				param.z = job->sprite.z;
-				param.rect = job->sprite.rect;
-				param.texHandle = job->sprite.texHandle;
+				const SPRITE_RENDER_JOB& param = *reinterpret_cast<SPRITE_RENDER_JOB*>(m_spriteJobs->Get(job->dataIdx));
+				const RECT* rect = param.hasRect ? &param.rect : nullptr;
 
 				TEXTURE_HANDLE* texHandle = reinterpret_cast<TEXTURE_HANDLE*>(param.texHandle);
 
-				// printf("%d %d %s\n", param.posX, param.posY, texHandle->name);
-
-
-				if (texHandle)
+				if (spriteBatching)
 				{
-					if (texHandle->uploadBuffer)
-					{
-						D3DUtils::UpdateTexture(m_device, cmdList, texHandle->textureResource, texHandle->uploadBuffer);
-					}
-
-					spriteObj->DrawWithTexture(cmdList, threadIdx, static_cast<float>(param.posX), static_cast<float>(param.posY), param.scaleX, param.scaleY, param.z, param.rect, texHandle);
+					spriteBatch.texHandle = GetSpriteTexture(job);
+					spriteBatch.spriteObjs[spriteBatch.spriteCount] = spriteObj;
+					spriteBatch.spriteJobs[spriteBatch.spriteCount] = &param;
+					spriteBatch.spriteCount++;
+				}
+				else if (texHandle)
+				{
+					spriteObj->DrawWithTexture(cmdState, threadIdx, static_cast<float>(param.posX), static_cast<float>(param.posY), param.scaleX, param.scaleY, param.z, rect, texHandle);
+					drawCount++;
 				}
 				else
 				{
-					spriteObj->Draw(cmdList, threadIdx, static_cast<float>(param.posX), static_cast<float>(param.posY), param.scaleX, param.scaleY, param.z);
+					spriteObj->Draw(cmdState, threadIdx, static_cast<float>(param.posX), static_cast<float>(param.posY), param.scaleX, param.scaleY, param.z);
+					drawCount++;
 				}
 			}
 			break;
@@ -125,7 +485,8 @@ uint32 RenderQueue::Process(uint32 threadIdx, CommandContext* cmdCtx, ID3D12Comm
 				{
 					__debugbreak();
 				}
-				lineObj->Draw(cmdList, threadIdx, job->line.worldRow);
+				lineObj->Draw(cmdState, threadIdx, *reinterpret_cast<Matrix*>(m_worldRows->Get(job->dataIdx)));
+				drawCount++;
 			}
 			break;
 			default:
@@ -140,54 +501,410 @@ uint32 RenderQueue::Process(uint32 threadIdx, CommandContext* cmdCtx, ID3D12Comm
 
 		if (procCountPerCmdList > processCountPerCmdList)
 		{
+			drawCount += FlushBatches(&instanceBatch, &spriteBatch, cmdState, threadIdx);
+
+			descPool->FlushCopies();
 			cmdCtx->Close();
-			cmdLists[cmdListCount] = cmdList;
-			cmdListCount++;
+			RecordCommandList(cmdList, cmdListFirstPos);
 			cmdList = nullptr;
 			procCountPerCmdList = 0;
 		}
 	}
 
+	drawCount += FlushBatches(&instanceBatch, &spriteBatch, cmdState, threadIdx);
+
 	if (procCountPerCmdList)
 	{
+		// Every table the list binds is copied by the time the list is closed.
+		descPool->FlushCopies();
 		cmdCtx->Close();
-		cmdLists[cmdListCount] = cmdList;
+		RecordCommandList(cmdList, cmdListFirstPos);
 		cmdList = nullptr;
-		cmdListCount++;
 		procCountPerCmdList = 0;
 	}
 
+	// The draws streamed their constants, make them visible before Submit hands the lists to the GPU.
+	ConstantWriter::Flush();
+
+	_InterlockedExchangeAdd(&m_drawCount, static_cast<long>(drawCount));
+
+	return processCount;
+}
+
+uint32 RenderQueue::Submit(ID3D12CommandQueue* cmdQueue)
+{
+	uint32 cmdListCount = static_cast<uint32>(m_recordedCmdListCount);
+
+	// Lists arrive mostly in order, each thread records its own ranges front to back.
+	for (uint32 i = 1; i < cmdListCount; i++)
+	{
+		RECORDED_COMMAND_LIST recorded = *GetRecordedCommandList(i);
+		uint32 j = i;
+		while (j > 0 && GetRecordedCommandList(j - 1)->firstJobPos > recorded.firstJobPos)
+		{
+			*GetRecordedCommandList(j) = *GetRecordedCommandList(j - 1);
+			j--;
+		}
+		*GetRecordedCommandList(j) = recorded;
+	}
+
+	ReserveSubmitBuffer(cmdListCount);
+	for (uint32 i = 0; i < cmdListCount; i++)
+	{
+		m_submitCmdLists[i] = GetRecordedCommandList(i)->cmdList;
+	}
+
 	if (cmdListCount)
 	{
-		cmdQueue->ExecuteCommandLists(cmdListCount, (ID3D12CommandList**)cmdLists);
+		cmdQueue->ExecuteCommandLists(cmdListCount, m_submitCmdLists);
 	}
-	
-	m_jobCount = 0;
 
-	return processCount;
+	m_recordedCmdListCount = 0;
+
+	return cmdListCount;
 }
 
 void RenderQueue::CleanUp()
 {
-	if (m_queueBuffer)
+	if (m_jobs)
+	{
+		delete m_jobs;
+		m_jobs = nullptr;
+	}
+	if (m_jobSortKeys)
+	{
+		delete m_jobSortKeys;
+		m_jobSortKeys = nullptr;
+	}
+	if (m_worldRows)
+	{
+		delete m_worldRows;
+		m_worldRows = nullptr;
+	}
+	if (m_spriteJobs)
+	{
+		delete m_spriteJobs;
+		m_spriteJobs = nullptr;
+	}
+	if (m_sortKeys)
+	{
+		free(m_sortKeys);
+		m_sortKeys = nullptr;
+	}
+	if (m_sortIndices)
+	{
+		free(m_sortIndices);
+		m_sortIndices = nullptr;
+	}
+	if (m_tempSortKeys)
+	{
+		free(m_tempSortKeys);
+		m_tempSortKeys = nullptr;
+	}
+	if (m_tempSortIndices)
+	{
+		free(m_tempSortIndices);
+		m_tempSortIndices = nullptr;
+	}
+	if (m_sortBlockDigitCounts)
+	{
+		delete[] m_sortBlockDigitCounts;
+		m_sortBlockDigitCounts = nullptr;
+	}
+	if (m_workQueues)
+	{
+		delete[] m_workQueues;
+		m_workQueues = nullptr;
+	}
+	if (m_recordedCmdLists)
+	{
+		delete m_recordedCmdLists;
+		m_recordedCmdLists = nullptr;
+	}
+	if (m_submitCmdLists)
+	{
+		free(m_submitCmdLists);
+		m_submitCmdLists = nullptr;
+	}
+}
+
+void RenderQueue::AddJob(uint64 sortKey, const RENDER_JOB* renderJob)
+{
+	// Reserve the slot first, producers on other threads never touch it afterwards.
+	uint32 writePos = static_cast<uint32>(_InterlockedIncrement(&m_writePos) - 1);
+
+	*reinterpret_cast<RENDER_JOB*>(m_jobs->Reserve(writePos)) = *renderJob;
+	*reinterpret_cast<uint64*>(m_jobSortKeys->Reserve(writePos)) = sortKey;
+}
+
+uint32 RenderQueue::AllocData(volatile long* dataCount)
+{
+	return static_cast<uint32>(_InterlockedIncrement(dataCount) - 1);
+}
+
+void RenderQueue::ReserveSortBuffer(uint32 jobCount)
+{
+	if (jobCount <= m_sortBufferSize)
+	{
+		return;
+	}
+
+	// Grow to the allocated segment capacity so a spike reallocates once.
+	uint32 sortBufferSize = m_jobs->GetCapacity();
+	if (sortBufferSize < jobCount)
+	{
+		sortBufferSize = jobCount;
+	}
+
+	m_sortKeys = (uint64*)realloc(m_sortKeys, sizeof(uint64) * sortBufferSize);
+	m_sortIndices = (uint32*)realloc(m_sortIndices, sizeof(uint32) * sortBufferSize);
+	m_tempSortKeys = (uint64*)realloc(m_tempSortKeys, sizeof(uint64) * sortBufferSize);
+	m_tempSortIndices = (uint32*)realloc(m_tempSortIndices, sizeof(uint32) * sortBufferSize);
+	m_sortBufferSize = sortBufferSize;
+}
+
+uint64 RenderQueue::GetStateBits(uint64 sortKey)
+{
+	// Only the bits above the depth bucket select pipeline and texture bindings. Sprite keys hold depth and submission
+	// order below the pso, neither binds anything.
+	uint32 shift = SORT_KEY_TEXTURE_SHIFT;
+	if ((sortKey >> SORT_KEY_PASS_SHIFT) == static_cast<uint64>(RENDER_PASS_TYPE::RENDER_PASS_SPRITE))
+	{
+		shift = SORT_KEY_PSO_SHIFT;
+	}
+
+	return sortKey & ~((1ull << shift) - 1);
+}
+
+bool RenderQueue::IsSortPassActive(uint32 pass)
+{
+	if (GetJobCount() < 2)
+	{
+		return false;
+	}
+
+	return RadixSort::IsPassActive(static_cast<uint64>(m_sortKeyAnd), static_cast<uint64>(m_sortKeyOr), pass);
+}
+
+void RenderQueue::GetSortBlockRange(uint32 blockIdx, uint32* beginPos, uint32* count)
+{
+	uint32 jobCount = GetJobCount();
+
+	*beginPos = blockIdx * m_sortBlockSize;
+	*count = 0;
+	if (*beginPos < jobCount)
+	{
+		*count = jobCount - *beginPos;
+		if (*count > m_sortBlockSize)
+		{
+			*count = m_sortBlockSize;
+		}
+	}
+}
+
+void RenderQueue::GetSortBuffers(uint32 pass, uint64** srcKeys, uint32** srcValues, uint64** destKeys, uint32** destValues)
+{
+	// Every active pass before this one swapped source and destination.
+	uint32 activePassCount = 0;
+	for (uint32 i = 0; i < pass; i++)
+	{
+		if (IsSortPassActive(i))
+		{
+			activePassCount++;
+		}
+	}
+
+	bool swapped = (activePassCount & 1) != 0;
+	*srcKeys = swapped ? m_tempSortKeys : m_sortKeys;
+	*srcValues = swapped ? m_tempSortIndices : m_sortIndices;
+	*destKeys = swapped ? m_sortKeys : m_tempSortKeys;
+	*destValues = swapped ? m_sortIndices : m_tempSortIndices;
+}
+
+uint32 RenderQueue::CountStateChanges(const uint64* sortKeys)
+{
+	uint32 jobCount = GetJobCount();
+	uint32 stateChangeCount = 0;
+	uint64 prevState = 0;
+
+	for (uint32 i = 0; i < jobCount; i++)
 	{
-		free(m_queueBuffer);
-		m_queueBuffer = nullptr;
+		uint64 state = GetStateBits(sortKeys[i]);
+		if (i == 0 || state != prevState)
+		{
+			stateChangeCount++;
+		}
+		prevState = state;
 	}
+
+	return stateChangeCount;
 }
 
-const RENDER_JOB* RenderQueue::Dispatch()
+bool RenderQueue::AcquireRange(uint32 threadIdx, bool stealWork, uint32* rangeIdx)
 {
-	RENDER_JOB* job = nullptr;
+	if (m_workQueues[threadIdx].Pop(rangeIdx))
+	{
+		return true;
+	}
 
-	if (m_readPos >= m_writePos)
+	if (!stealWork)
 	{
-		return job;
+		return false;
 	}
 
-	job = reinterpret_cast<RENDER_JOB*>(m_queueBuffer + m_readPos);
-	
-	m_readPos += sizeof(RENDER_JOB);
+	for (uint32 i = 1; i < m_workQueueCount; i++)
+	{
+		uint32 victimIdx = (threadIdx + i) % m_workQueueCount;
+		uint32 stolenBegin = 0;
+		uint32 stolenEnd = 0;
+		if (m_workQueues[victimIdx].Steal(&stolenBegin, &stolenEnd))
+		{
+			// The rest of the chunk goes to our own queue, the thread keeps popping adjacent ranges into one list
+			// and other thieves can split it again.
+			m_workQueues[threadIdx].Reset(stolenBegin + 1, stolenEnd);
+			*rangeIdx = stolenBegin;
+			_InterlockedIncrement(&m_stealCount);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const RENDER_JOB* RenderQueue::Dispatch(uint32 threadIdx, bool stealWork, uint32* readPos, uint32* endPos)
+{
+	const RENDER_JOB* job = nullptr;
+
+	if (*readPos >= *endPos)
+	{
+		uint32 rangeIdx = 0;
+		if (!AcquireRange(threadIdx, stealWork, &rangeIdx))
+		{
+			return job;
+		}
+
+		uint32 jobCount = GetJobCount();
+		*readPos = rangeIdx * JOB_RANGE_SIZE;
+		*endPos = *readPos + JOB_RANGE_SIZE;
+		if (*endPos > jobCount)
+		{
+			*endPos = jobCount;
+		}
+	}
+
+	job = reinterpret_cast<RENDER_JOB*>(m_jobs->Get(m_sortIndices[*readPos]));
+	(*readPos)++;
 
 	return job;
 }
+
+TEXTURE_HANDLE* RenderQueue::GetSpriteTexture(const RENDER_JOB* renderJob)
+{
+	// Sprites drawn without a texture argument use the object's own texture.
+	const SPRITE_RENDER_JOB* spriteJob = reinterpret_cast<SPRITE_RENDER_JOB*>(m_spriteJobs->Get(renderJob->dataIdx));
+	if (spriteJob->texHandle)
+	{
+		return reinterpret_cast<TEXTURE_HANDLE*>(spriteJob->texHandle);
+	}
+
+	// Replayed jobs have no object.
+	SpriteObject* spriteObj = reinterpret_cast<SpriteObject*>(renderJob->obj);
+	return spriteObj ? spriteObj->GetTextureHandle() : nullptr;
+}
+
+void RenderQueue::RecordCommandList(ID3D12GraphicsCommandList* cmdList, uint32 firstJobPos)
+{
+	uint32 recordIdx = static_cast<uint32>(_InterlockedIncrement(&m_recordedCmdListCount) - 1);
+
+	RECORDED_COMMAND_LIST* recorded = reinterpret_cast<RECORDED_COMMAND_LIST*>(m_recordedCmdLists->Reserve(recordIdx));
+	recorded->firstJobPos = firstJobPos;
+	recorded->cmdList = cmdList;
+}
+
+RECORDED_COMMAND_LIST* RenderQueue::GetRecordedCommandList(uint32 recordIdx)
+{
+	return reinterpret_cast<RECORDED_COMMAND_LIST*>(m_recordedCmdLists->Get(recordIdx));
+}
+
+void RenderQueue::ReserveSubmitBuffer(uint32 cmdListCount)
+{
+	if (cmdListCount <= m_submitBufferSize)
+	{
+		return;
+	}
+
+	m_submitCmdLists = (ID3D12CommandList**)realloc(m_submitCmdLists, sizeof(ID3D12CommandList*) * cmdListCount);
+	m_submitBufferSize = cmdListCount;
+}
+
+uint32 RenderQueue::FlushBatches(MESH_INSTANCE_BATCH* instanceBatch, SPRITE_BATCH* spriteBatch, CommandListState* cmdState, uint32 threadIdx)
+{
+	uint32 drawCount = 0;
+
+	if (instanceBatch->instanceCount)
+	{
+		drawCount += FlushInstanceBatch(instanceBatch, cmdState, threadIdx);
+	}
+	if (spriteBatch->spriteCount)
+	{
+		drawCount += FlushSpriteBatch(spriteBatch, cmdState, threadIdx);
+	}
+
+	return drawCount;
+}
+
+uint32 RenderQueue::FlushInstanceBatch(MESH_INSTANCE_BATCH* batch, CommandListState* cmdState, uint32 threadIdx)
+{
+	MeshObject* meshObj = reinterpret_cast<MeshObject*>(batch->obj);
+	uint32 drawCount = 0;
+
+	if (batch->instanceCount > 1 && meshObj->DrawInstanced(cmdState, threadIdx, batch->worldRows, batch->instanceCount, batch->isWire))
+	{
+		drawCount = 1;
+	}
+	else
+	{
+		// A single job, or the instance buffer ran out for this frame.
+		for (uint32 i = 0; i < batch->instanceCount; i++)
+		{
+			meshObj->Draw(cmdState, threadIdx, *batch->worldRows[i], batch->isWire);
+		}
+		drawCount = batch->instanceCount;
+	}
+
+	batch->instanceCount = 0;
+
+	return drawCount;
+}
+
+uint32 RenderQueue::FlushSpriteBatch(SPRITE_BATCH* batch, CommandListState* cmdState, uint32 threadIdx)
+{
+	uint32 drawCount = 0;
+
+	if (SpriteObject::DrawBatch(cmdState, threadIdx, batch->spriteObjs, batch->spriteJobs, batch->spriteCount, batch->texHandle))
+	{
+		drawCount = 1;
+	}
+	else
+	{
+		// The vertex budget ran out for this frame.
+		for (uint32 i = 0; i < batch->spriteCount; i++)
+		{
+			const SPRITE_RENDER_JOB* param = batch->spriteJobs[i];
+			if (param->texHandle)
+			{
+				const RECT* rect = param->hasRect ? &param->rect : nullptr;
+				batch->spriteObjs[i]->DrawWithTexture(cmdState, threadIdx, static_cast<float>(param->posX), static_cast<float>(param->posY), param->scaleX, param->scaleY, param->z, rect, reinterpret_cast<TEXTURE_HANDLE*>(param->texHandle));
+			}
+			else
+			{
+				batch->spriteObjs[i]->Draw(cmdState, threadIdx, static_cast<float>(param->posX), static_cast<float>(param->posY), param->scaleX, param->scaleY, param->z);
+			}
+		}
+		drawCount = batch->spriteCount;
+	}
+
+	batch->spriteCount = 0;
+
+	return drawCount;
+}
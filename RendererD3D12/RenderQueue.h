@@ -1,45 +1,76 @@
 #pragma once
 
-enum class RENDER_JOB_TYPE
+enum class RENDER_JOB_TYPE : uint8
 {
 	RENDER_MESH_OBJECT,
 	RENDER_SPRITE_OBJECT,
 	RENDER_LINE_OBJECT,
 };
 
-struct MESH_RENDER_JOB
+enum class RENDER_PASS_TYPE
 {
-	Matrix worldRow;
-	bool isWire;
+	RENDER_PASS_OPAQUE,
+	RENDER_PASS_SPRITE,
 };
 
-struct SPRITE_RENDER_JOB
+enum class RENDER_PIPELINE_TYPE
 {
-	uint32 posX;
-	uint32 posY;
-	float scaleX;
-	float scaleY;
-	float z;
-	const RECT* rect;
-	void* texHandle;
-	char name[32];
+	MESH_DEFAULT_PIPELINE,
+	MESH_WIRE_PIPELINE,
+	LINE_PIPELINE,
+	SPRITE_PIPELINE,
 };
 
-struct LINE_RENDER_JOB
+struct SPRITE_RENDER_JOB
 {
-	Matrix worldRow;
+	uint32 posX = 0;
+	uint32 posY = 0;
+	float scaleX = 1.0f;
+	float scaleY = 1.0f;
+	float z = 0.0f;
+	bool hasRect = false;
+	RECT rect = {};
+	void* texHandle = nullptr;
 };
 
+// Fixed size header of a job. Per type data lives in the queue's side arrays at dataIdx.
 struct RENDER_JOB
 {
 	RENDER_JOB_TYPE type = {};
+	bool isWire = false;
+	uint32 dataIdx = 0;
 	void* obj = nullptr;
-	union
-	{
-		MESH_RENDER_JOB mesh;
-		SPRITE_RENDER_JOB sprite;
-		LINE_RENDER_JOB line;
-	};
+};
+
+class SpriteObject;
+
+// Consecutive jobs of the same mesh gathered for one instanced draw.
+struct MESH_INSTANCE_BATCH
+{
+	static const uint32 MAX_INSTANCE_COUNT = 256;
+
+	void* obj = nullptr;
+	bool isWire = false;
+	uint32 instanceCount = 0;
+	const Matrix* worldRows[MAX_INSTANCE_COUNT] = {};
+};
+
+// Consecutive sprite jobs sharing a texture gathered for one batched draw.
+struct SPRITE_BATCH
+{
+	static const uint32 MAX_SPRITE_COUNT = 1024;
+
+	TEXTURE_HANDLE* texHandle = nullptr;
+	uint32 spriteCount = 0;
+	SpriteObject* spriteObjs[MAX_SPRITE_COUNT] = {};
+	const SPRITE_RENDER_JOB* spriteJobs[MAX_SPRITE_COUNT] = {};
+};
+
+// A closed command list and the sorted position of its first job.
+struct RECORDED_COMMAND_LIST
+{
+	uint32 firstJobPos = 0;
+	ID3D12GraphicsCommandList* cmdList = nullptr;
 };
 
 /*
@@ -49,28 +80,135 @@ RenderQueue
 */
 
 class CommandContext;
+class CommandListState;
+class DescriptorPool;
+class WorkStealingQueue;
+class SegmentedArray;
+class MeshObject;
+class LineObject;
 
 class RenderQueue
 {
 public:
+	/*
+	Sort key layout (msb -> lsb)
+	[63:60] pass | [59:56] root signature | [55:48] pso | [47:28] texture | [27:16] batch | [15:0] depth
+	Jobs that can share one instanced draw get the same batch id so they end up adjacent.
+	Sprites draw without blending and with LESS_EQUAL depth, so sprites at one z must keep their submission order:
+	[63:60] pass | [59:56] root signature | [55:48] pso | [47:32] depth | [31:0] submission index
+	Consecutive sprites of one texture still batch.
+	*/
+	static const uint32 SORT_KEY_PASS_SHIFT = 60;
+	static const uint32 SORT_KEY_ROOT_SIGNATURE_SHIFT = 56;
+	static const uint32 SORT_KEY_PSO_SHIFT = 48;
+	static const uint32 SORT_KEY_TEXTURE_SHIFT = 28;
+	static const uint32 SORT_KEY_BATCH_SHIFT = 16;
+	static const uint32 SORT_KEY_DEPTH_SHIFT = 0;
+	static const uint32 SORT_KEY_SPRITE_DEPTH_SHIFT = 32;
+	static const uint32 SORT_KEY_TEXTURE_MASK = 0xfffff;
+	static const uint32 SORT_KEY_BATCH_MASK = 0xfff;
+	static const uint32 SORT_KEY_DEPTH_MASK = 0xffff;
+	static const uint64 SORT_KEY_SUBMIT_MASK = 0xffffffff;
+	static const uint32 JOB_RANGE_SIZE = 32;
+	static const uint32 INITIAL_COMMAND_LIST_COUNT_PER_THREAD = 4;
+	static const uint32 SORT_BLOCK_SIZE = 4096;
+	static const uint32 MAX_SORT_BLOCK_COUNT = 64;		// bigger frames get bigger blocks
+
+	// textureId and batchId are ignored for SPRITE_PIPELINE, AddSpriteJob fills in the submission index.
+	static uint64 MakeSortKey(RENDER_PIPELINE_TYPE pipelineType, uint32 textureId, uint32 batchId, float depth);
+
 	RenderQueue();
 	~RenderQueue();
 
-	bool Initialize(ID3D12Device5* device, uint32 maxNumJob);
-	void Add(const RENDER_JOB* renderJob);
+	// initialNumJob only sizes the first allocation, the queue grows by segments when a frame needs more.
+	bool Initialize(ID3D12Device5* device, uint32 initialNumJob, uint32 maxThreadCount);
+	// Safe to call from any number of threads at once. Every producer must have returned before Distribute.
+	void AddMeshJob(uint64 sortKey, MeshObject* meshObj, const Matrix& worldRow, bool isWire);
+	void AddSpriteJob(uint64 sortKey, SpriteObject* spriteObj, const SPRITE_RENDER_JOB* spriteJob);
+	void AddLineJob(uint64 sortKey, LineObject* lineObj, const Matrix& worldRow);
 	void Free();
-	uint32 Process(uint32 threadIdx, CommandContext* cmdCtx, ID3D12CommandQueue* cmdQueue, uint32 processCountPerCmdList, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle, D3D12_VIEWPORT viewPort, D3D12_RECT scissorRect);
+	// Sorts the jobs and splits them into ranges spread over the threads' work queues.
+	void Distribute(uint32 threadCount);
+	// Distribute in steps for callers spreading it over workers: PrepareSort, then GatherSortKeys for each gather item,
+	// then for every radix pass CountSortBlock and after it ScatterSortBlock for each sort block, then SortAndSplit.
+	// The items of one step may run in any order or in parallel.
+	uint32 PrepareSort();
+	void GatherSortKeys(uint32 gatherIdx);
+	inline uint32 GetSortBlockCount() { return m_sortBlockCount; }
+	void CountSortBlock(uint32 pass, uint32 blockIdx);
+	void ScatterSortBlock(uint32 pass, uint32 blockIdx);
+	void SortAndSplit(uint32 threadCount);
+	// Only records. A command list never holds jobs that are not consecutive in sorted order.
+	uint32 Process(uint32 threadIdx, CommandContext* cmdCtx, DescriptorPool* descPool, uint32 processCountPerCmdList, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle, D3D12_VIEWPORT viewPort, D3D12_RECT scissorRect, bool stealWork);
+	// Executes the lists recorded by every Process call of the frame in one call, in sorted job order. Call once all Process calls returned.
+	uint32 Submit(ID3D12CommandQueue* cmdQueue);
+
+	inline uint32 GetJobCount() { return static_cast<uint32>(m_writePos); }
+	inline uint32 GetUnsortedStateChangeCount() { return static_cast<uint32>(m_unsortedStateChangeCount); }
+	inline uint32 GetSortedStateChangeCount() { return m_sortedStateChangeCount; }
+	inline uint32 GetStealCount() { return static_cast<uint32>(m_stealCount); }
+	inline uint32 GetDrawCount() { return static_cast<uint32>(m_drawCount); }
+	uint64 GetSubmittedBytes();
+	inline uint32 GetFrameHighWaterMark() { return m_frameHighWaterMark; }
+	inline uint32 GetHighWaterMark() { return m_highWaterMark; }
+	uint32 GetSegmentCount();
+	// Jobs in submission order, valid between the Add calls and Free.
+	const RENDER_JOB* GetJob(uint32 jobIdx);
+	uint64 GetJobSortKey(uint32 jobIdx);
+	const Matrix* GetWorldRow(const RENDER_JOB* renderJob);
+	const SPRITE_RENDER_JOB* GetSpriteJob(const RENDER_JOB* renderJob);
 
 private:
 	void CleanUp();
-	const RENDER_JOB* Dispatch();
+	void AddJob(uint64 sortKey, const RENDER_JOB* renderJob);
+	uint32 AllocData(volatile long* dataCount);
+	void ReserveSortBuffer(uint32 jobCount);
+	uint32 CountStateChanges(const uint64* sortKeys);
+	static uint64 GetStateBits(uint64 sortKey);
+	bool IsSortPassActive(uint32 pass);
+	void GetSortBlockRange(uint32 blockIdx, uint32* beginPos, uint32* count);
+	void GetSortBuffers(uint32 pass, uint64** srcKeys, uint32** srcValues, uint64** destKeys, uint32** destValues);
+	bool AcquireRange(uint32 threadIdx, bool stealWork, uint32* rangeIdx);
+	const RENDER_JOB* Dispatch(uint32 threadIdx, bool stealWork, uint32* readPos, uint32* endPos);
+	TEXTURE_HANDLE* GetSpriteTexture(const RENDER_JOB* renderJob);
+	uint32 FlushBatches(MESH_INSTANCE_BATCH* instanceBatch, SPRITE_BATCH* spriteBatch, CommandListState* cmdState, uint32 threadIdx);
+	uint32 FlushInstanceBatch(MESH_INSTANCE_BATCH* batch, CommandListState* cmdState, uint32 threadIdx);
+	uint32 FlushSpriteBatch(SPRITE_BATCH* batch, CommandListState* cmdState, uint32 threadIdx);
+	void RecordCommandList(ID3D12GraphicsCommandList* cmdList, uint32 firstJobPos);
+	RECORDED_COMMAND_LIST* GetRecordedCommandList(uint32 recordIdx);
+	void ReserveSubmitBuffer(uint32 cmdListCount);
 
 private:
 	ID3D12Device5* m_device = nullptr;
-	uint8* m_queueBuffer = nullptr;
-	uint32 m_maxBufferSize = 0;
-	uint32 m_readPos = 0;
-	uint32 m_writePos = 0;
-	uint32 m_jobCount = 0;
+	SegmentedArray* m_jobs = nullptr;
+	SegmentedArray* m_jobSortKeys = nullptr;
+	SegmentedArray* m_worldRows = nullptr;
+	SegmentedArray* m_spriteJobs = nullptr;
+	uint64* m_sortKeys = nullptr;
+	uint32* m_sortIndices = nullptr;
+	uint64* m_tempSortKeys = nullptr;
+	uint32* m_tempSortIndices = nullptr;
+	uint32* m_sortBlockDigitCounts = nullptr;		// RadixSort::RADIX_SIZE counts for each sort block
+	WorkStealingQueue* m_workQueues = nullptr;
+	SegmentedArray* m_recordedCmdLists = nullptr;
+	ID3D12CommandList** m_submitCmdLists = nullptr;
+	uint32 m_submitBufferSize = 0;
+	uint32 m_sortBufferSize = 0;
+	uint32 m_maxThreadCount = 0;
+	uint32 m_workQueueCount = 0;
+	uint32 m_sortBlockCount = 0;
+	uint32 m_sortBlockSize = 0;
+	volatile long long m_sortKeyAnd = 0;
+	volatile long long m_sortKeyOr = 0;
+	volatile long m_writePos = 0;
+	volatile long m_worldRowCount = 0;
+	volatile long m_spriteJobCount = 0;
+	volatile long m_stealCount = 0;
+	volatile long m_drawCount = 0;
+	volatile long m_recordedCmdListCount = 0;
+	volatile long m_unsortedStateChangeCount = 0;
+	uint32 m_sortedStateChangeCount = 0;
+	uint32 m_frameHighWaterMark = 0;
+	uint32 m_highWaterMark = 0;
 };
 
@@ -0,0 +1,183 @@
+#include "pch.h"
+#include "RenderQueue.h"
+#include "RenderCapture.h"
+#include "RenderReplay.h"
+
+/*
+=================
+RenderReplay
+=================
+*/
+
+RenderReplay::RenderReplay()
+{
+}
+
+RenderReplay::~RenderReplay()
+{
+	CleanUp();
+}
+
+bool RenderReplay::Initialize(const wchar_t* filename)
+{
+	if (_wfopen_s(&m_file, filename, L"rb") != 0 || !m_file)
+	{
+		m_file = nullptr;
+		return false;
+	}
+
+	RENDER_CAPTURE_FILE_HEADER fileHeader = {};
+	if (fread(&fileHeader, sizeof(fileHeader), 1, m_file) != 1)
+	{
+		CleanUp();
+		return false;
+	}
+	if (fileHeader.magic != RenderCapture::CAPTURE_MAGIC || fileHeader.version != RenderCapture::CAPTURE_VERSION)
+	{
+		CleanUp();
+		return false;
+	}
+
+	m_frameCount = 0;
+
+	return true;
+}
+
+void RenderReplay::SetTextureTable(TEXTURE_HANDLE* const* textureHandles, uint32 textureCount)
+{
+	m_textureHandles = textureHandles;
+	m_textureCount = textureCount;
+}
+
+bool RenderReplay::ReadFrame(RenderQueue* renderQueue, Matrix* viewRow, Matrix* projRow)
+{
+	if (!m_file)
+	{
+		return false;
+	}
+
+	RENDER_CAPTURE_FRAME_HEADER frameHeader = {};
+	if (fread(&frameHeader, sizeof(frameHeader), 1, m_file) != 1)
+	{
+		return false;
+	}
+
+	for (uint32 i = 0; i < frameHeader.jobCount; i++)
+	{
+		RENDER_CAPTURE_JOB captureJob = {};
+		if (fread(&captureJob, sizeof(captureJob), 1, m_file) != 1)
+		{
+			return false;
+		}
+
+		switch (captureJob.type)
+		{
+			case RENDER_JOB_TYPE::RENDER_MESH_OBJECT:
+			case RENDER_JOB_TYPE::RENDER_LINE_OBJECT:
+			{
+				Matrix worldRow;
+				if (fread(&worldRow, sizeof(Matrix), 1, m_file) != 1)
+				{
+					return false;
+				}
+
+				if (captureJob.type == RENDER_JOB_TYPE::RENDER_MESH_OBJECT)
+				{
+					renderQueue->AddMeshJob(captureJob.sortKey, nullptr, worldRow, captureJob.isWire);
+				}
+				else
+				{
+					renderQueue->AddLineJob(captureJob.sortKey, nullptr, worldRow);
+				}
+			}
+			break;
+			case RENDER_JOB_TYPE::RENDER_SPRITE_OBJECT:
+			{
+				RENDER_CAPTURE_SPRITE_JOB captureSpriteJob = {};
+				if (fread(&captureSpriteJob, sizeof(captureSpriteJob), 1, m_file) != 1)
+				{
+					return false;
+				}
+
+				SPRITE_RENDER_JOB spriteJob = {};
+				spriteJob.posX = captureSpriteJob.posX;
+				spriteJob.posY = captureSpriteJob.posY;
+				spriteJob.scaleX = captureSpriteJob.scaleX;
+				spriteJob.scaleY = captureSpriteJob.scaleY;
+				spriteJob.z = captureSpriteJob.z;
+				spriteJob.hasRect = captureSpriteJob.hasRect != 0;
+				spriteJob.rect = captureSpriteJob.rect;
+				// Texture id 0 is a sprite drawn without a texture.
+				if (captureSpriteJob.textureId && captureSpriteJob.textureId < m_textureCount)
+				{
+					spriteJob.texHandle = m_textureHandles[captureSpriteJob.textureId];
+				}
+				renderQueue->AddSpriteJob(captureJob.sortKey, nullptr, &spriteJob);
+			}
+			break;
+			default:
+			{
+				// Unknown job types mean a corrupt or newer file, the rest of it can't be parsed.
+				return false;
+			}
+			break;
+		}
+	}
+
+	if (viewRow)
+	{
+		*viewRow = frameHeader.viewRow;
+	}
+	if (projRow)
+	{
+		*projRow = frameHeader.projRow;
+	}
+
+	m_frameCount++;
+
+	return true;
+}
+
+bool RenderReplay::Run(RenderQueue* renderQueue, uint32 threadCount, RENDER_REPLAY_STATS* stats)
+{
+	*stats = {};
+	if (!m_file)
+	{
+		return false;
+	}
+
+	while (true)
+	{
+		long startPos = ftell(m_file);
+		if (!ReadFrame(renderQueue, nullptr, nullptr))
+		{
+			// A clean end of file stops right at a frame header.
+			bool complete = feof(m_file) && ftell(m_file) == startPos;
+			renderQueue->Free();
+			return complete;
+		}
+
+		auto startTime = std::chrono::steady_clock::now();
+		renderQueue->Distribute(threadCount);
+		uint64 frameMicroseconds = static_cast<uint64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count());
+
+		stats->frameCount++;
+		stats->jobCount += renderQueue->GetJobCount();
+		stats->distributeMicroseconds += frameMicroseconds;
+		if (frameMicroseconds > stats->maxFrameDistributeMicroseconds)
+		{
+			stats->maxFrameDistributeMicroseconds = frameMicroseconds;
+		}
+
+		renderQueue->Free();
+	}
+}
+
+void RenderReplay::CleanUp()
+{
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
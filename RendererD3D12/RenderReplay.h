@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+=================
+RenderReplay
+=================
+*/
+
+class RenderQueue;
+
+// Totals of one RenderReplay::Run.
+struct RENDER_REPLAY_STATS
+{
+	uint32 frameCount = 0;
+	uint64 jobCount = 0;
+	uint64 distributeMicroseconds = 0;
+	uint64 maxFrameDistributeMicroseconds = 0;
+};
+
+/*
+Feeds a file written by RenderCapture back into a RenderQueue, one frame per ReadFrame call.
+Objects are not restored: jobs are added with null objects and their captured sort keys,
+so the queue can be driven through Distribute without a device to time sorting and splitting.
+Sprite jobs get their texture back through the table passed to SetTextureTable, indexed by the captured texture id.
+*/
+class RenderReplay
+{
+public:
+	RenderReplay();
+	~RenderReplay();
+
+	bool Initialize(const wchar_t* filename);
+	// textureHandles[id] is the texture replayed sprites captured with texture id use. The table must outlive the replay.
+	void SetTextureTable(TEXTURE_HANDLE* const* textureHandles, uint32 textureCount);
+	// Returns false at the end of the file. Call renderQueue->Free() before reading the next frame.
+	bool ReadFrame(RenderQueue* renderQueue, Matrix* viewRow, Matrix* projRow);
+	// The replay driver. Reads every remaining frame into renderQueue, runs Distribute over threadCount threads
+	// and frees the queue again, timing only Distribute. Returns false if the file ended inside a frame.
+	bool Run(RenderQueue* renderQueue, uint32 threadCount, RENDER_REPLAY_STATS* stats);
+
+	inline uint32 GetFrameCount() { return m_frameCount; }
+
+private:
+	void CleanUp();
+
+private:
+	FILE* m_file = nullptr;
+	TEXTURE_HANDLE* const* m_textureHandles = nullptr;
+	uint32 m_textureCount = 0;
+	uint32 m_frameCount = 0;
+};
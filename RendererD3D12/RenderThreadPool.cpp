@@ -0,0 +1,160 @@
+#include "pch.h"
+#include "RenderThreadPool.h"
+
+/*
+=====================
+RenderThreadPool
+=====================
+*/
+
+RenderThreadPool::RenderThreadPool()
+{
+}
+
+RenderThreadPool::~RenderThreadPool()
+{
+	CleanUp();
+}
+
+bool RenderThreadPool::Initialize(uint32 threadCount, RENDER_THREAD_FUNC func, void* context)
+{
+	m_threadCount = threadCount;
+	m_func = func;
+	m_context = context;
+
+	// Workers start from this generation, a Dispatch issued before a worker got scheduled is not missed.
+	uint32 generation = static_cast<uint32>(m_dispatchState.load(std::memory_order_acquire) >> 32);
+
+	m_threads = new std::thread[threadCount];
+	for (uint32 i = 0; i < threadCount; i++)
+	{
+		m_threads[i] = std::thread(&RenderThreadPool::WorkerMain, this, i, generation);
+	}
+
+	return true;
+}
+
+void RenderThreadPool::Dispatch(uint32 activeThreadCount)
+{
+	DispatchAsync(activeThreadCount);
+	WaitForCompletion();
+}
+
+void RenderThreadPool::DispatchAsync(uint32 activeThreadCount)
+{
+	if (activeThreadCount > m_threadCount)
+	{
+		activeThreadCount = m_threadCount;
+	}
+	if (activeThreadCount == 0)
+	{
+		return;
+	}
+
+	uint32 generation = static_cast<uint32>(m_dispatchState.load(std::memory_order_relaxed) >> 32) + 1;
+
+	m_pendingCount.store(activeThreadCount, std::memory_order_relaxed);
+	m_dispatchState.store((static_cast<uint64>(generation) << 32) | activeThreadCount, std::memory_order_seq_cst);
+
+	// Workers that are still spinning see the new generation on their own.
+	if (m_parkedCount.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wakeCondition.notify_all();
+	}
+}
+
+void RenderThreadPool::CleanUp()
+{
+	if (m_threads)
+	{
+		uint32 generation = static_cast<uint32>(m_dispatchState.load(std::memory_order_relaxed) >> 32) + 1;
+
+		m_exit.store(true, std::memory_order_seq_cst);
+		m_dispatchState.store((static_cast<uint64>(generation) << 32) | m_threadCount, std::memory_order_seq_cst);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_wakeCondition.notify_all();
+		}
+
+		for (uint32 i = 0; i < m_threadCount; i++)
+		{
+			m_threads[i].join();
+		}
+
+		delete[] m_threads;
+		m_threads = nullptr;
+	}
+	m_threadCount = 0;
+}
+
+void RenderThreadPool::WorkerMain(uint32 threadIdx, uint32 seenGeneration)
+{
+	while (true)
+	{
+		// An idle worker may skip several generations, it picks up the one it is woken for.
+		if (!WaitForDispatch(threadIdx, seenGeneration, &seenGeneration))
+		{
+			// Exit render thread.
+			break;
+		}
+
+		m_func(m_context, threadIdx);
+
+		if (m_pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_doneCondition.notify_one();
+		}
+	}
+}
+
+bool RenderThreadPool::WaitForDispatch(uint32 threadIdx, uint32 seenGeneration, uint32* generation)
+{
+	for (uint32 i = 0; i < SPIN_COUNT; i++)
+	{
+		if (IsDispatched(threadIdx, seenGeneration, generation))
+		{
+			return !m_exit.load(std::memory_order_acquire);
+		}
+		std::this_thread::yield();
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_parkedCount.fetch_add(1, std::memory_order_seq_cst);
+	m_parkCount.fetch_add(1, std::memory_order_relaxed);
+	m_wakeCondition.wait(lock, [this, threadIdx, seenGeneration, generation]() { return IsDispatched(threadIdx, seenGeneration, generation); });
+	m_parkedCount.fetch_sub(1, std::memory_order_relaxed);
+
+	return !m_exit.load(std::memory_order_acquire);
+}
+
+bool RenderThreadPool::IsDispatched(uint32 threadIdx, uint32 seenGeneration, uint32* generation)
+{
+	uint64 dispatchState = m_dispatchState.load(std::memory_order_seq_cst);
+	uint32 curGeneration = static_cast<uint32>(dispatchState >> 32);
+	uint32 activeThreadCount = static_cast<uint32>(dispatchState);
+
+	if (curGeneration == seenGeneration || threadIdx >= activeThreadCount)
+	{
+		return false;
+	}
+
+	*generation = curGeneration;
+	return true;
+}
+
+void RenderThreadPool::WaitForCompletion()
+{
+	for (uint32 i = 0; i < SPIN_COUNT; i++)
+	{
+		if (m_pendingCount.load(std::memory_order_acquire) == 0)
+		{
+			return;
+		}
+		std::this_thread::yield();
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this]() { return m_pendingCount.load(std::memory_order_acquire) == 0; });
+}
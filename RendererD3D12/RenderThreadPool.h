@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+=====================
+RenderThreadPool
+=====================
+*/
+
+typedef void (*RENDER_THREAD_FUNC)(void* context, uint32 threadIdx);
+
+// Persistent workers that run func once per Dispatch. Waiting spins first and parks on a condition variable only after SPIN_COUNT tries.
+// Only the first activeThreadCount workers take part in a dispatch, the rest keep waiting.
+class RenderThreadPool
+{
+public:
+	static const uint32 SPIN_COUNT = 4096;
+
+	RenderThreadPool();
+	~RenderThreadPool();
+
+	bool Initialize(uint32 threadCount, RENDER_THREAD_FUNC func, void* context);
+	// Runs func on workers [0, activeThreadCount) and returns once all of them are done. The pool can be dispatched again right away.
+	void Dispatch(uint32 activeThreadCount);
+	// Same as Dispatch without waiting. WaitForCompletion must return before the next dispatch.
+	void DispatchAsync(uint32 activeThreadCount);
+	void WaitForCompletion();
+
+	inline uint32 GetThreadCount() { return m_threadCount; }
+	inline bool IsBusy() { return m_pendingCount.load(std::memory_order_acquire) != 0; }
+	inline uint64 GetParkCount() { return m_parkCount.load(std::memory_order_relaxed); }
+
+private:
+	void CleanUp();
+	void WorkerMain(uint32 threadIdx, uint32 seenGeneration);
+	bool WaitForDispatch(uint32 threadIdx, uint32 seenGeneration, uint32* generation);
+	bool IsDispatched(uint32 threadIdx, uint32 seenGeneration, uint32* generation);
+
+private:
+	std::thread* m_threads = nullptr;
+	uint32 m_threadCount = 0;
+	RENDER_THREAD_FUNC m_func = nullptr;
+	void* m_context = nullptr;
+
+	// Frame barrier: Dispatch bumps the generation, each active worker counts itself out of m_pendingCount.
+	// Generation in the high 32 bits and active thread count in the low 32 bits, so workers read both at once.
+	std::atomic<uint64> m_dispatchState = { 0 };
+	std::atomic<uint32> m_pendingCount = { 0 };
+	std::atomic<uint32> m_parkedCount = { 0 };
+	std::atomic<uint64> m_parkCount = { 0 };
+	std::atomic<bool> m_exit = { false };
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_doneCondition;
+};
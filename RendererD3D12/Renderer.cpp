@@ -4,11 +4,18 @@
 #include "SpriteObject.h"
 #include "FontManager.h"
 #include "ResourceManager.h"
-#include "ConstantBufferManager.h"
+#include "ConstantBufferPool.h"
+#include "ConstantWriter.h"
+#include "PersistentConstantPool.h"
+#include "InstanceBufferPool.h"
 #include "TextureManager.h"
 #include "DescriptorAllocator.h"
 #include "DescriptorPool.h"
+#include "DescriptorRing.h"
 #include "RenderQueue.h"
+#include "RenderCapture.h"
+#include "TaskGraph.h"
+#include "RadixSort.h"
 #include "CommandContext.h"
 #include "LineObject.h"
 
@@ -123,33 +130,40 @@ bool Renderer::Initialize(HWND hwnd, bool enableDebugLayer, bool enableGBV)
 	uint32 logicalCoreCount = 0;
 	GetPhysicalCoreCount(&physicalCoreCount, &logicalCoreCount);
 	m_renderThreadCount = physicalCoreCount;
-	if (m_renderThreadCount > MAX_THREAD_COUNT)
+	if (m_renderThreadCount == 0)
 	{
-		m_renderThreadCount = MAX_THREAD_COUNT;
+		m_renderThreadCount = 1;
 	}
-	// Create the thread elements.
-#if MULTI_THREAD_RENDERING
-	CreateThreadPool(m_renderThreadCount);
-#endif
-	// Create the descriptor allocator.
+	LARGE_INTEGER frequency = {};
+	QueryPerformanceFrequency(&frequency);
+	m_counterFrequency = frequency.QuadPart;
+	// Create the fence, the descriptor ring waits on it.
+	CreateFence();
+	// Create the descriptor allocator, its shader visible heap also holds the transient descriptors of every frame in flight.
+	// A frame gets the draw budget plus the block every thread may leave part used. A bigger frame waits for older ones.
+	uint32 transientDescriptorCount = FRAME_PENDING_COUNT * (MAX_DRAW_COUNT_PER_FRAME * MeshObject::MAX_DESCRIPTOR_COUNT_FOR_DRAW + m_renderThreadCount * DescriptorRing::BLOCK_SIZE);
 	m_descriptorAllocator = new DescriptorAllocator;
-	m_descriptorAllocator->Initialize(m_device, MAX_DESCRIPTOR_COUNT);
+	m_descriptorAllocator->Initialize(m_device, MAX_DESCRIPTOR_COUNT, transientDescriptorCount);
+	// Create the descriptor ring over the transient part.
+	m_descriptorRing = new DescriptorRing;
+	m_descriptorRing->Initialize(m_device, m_descriptorAllocator->GetShaderVisibleHeap(), MAX_DESCRIPTOR_COUNT, transientDescriptorCount, FRAME_PENDING_COUNT, m_fence);
+	// Create the persistent constant pool.
+	m_persistentConstantPool = new PersistentConstantPool;
+	m_persistentConstantPool->Initialize(m_device, FRAME_PENDING_COUNT);
 
 	for (uint32 i = 0; i < FRAME_PENDING_COUNT; i++)
 	{
-		for (uint32 j = 0; j < m_renderThreadCount; j++)
-		{
-			// Create the desciptor pool.
-			m_descriptorPool[i][j] = new DescriptorPool;
-			m_descriptorPool[i][j]->Initialize(m_device, MAX_DRAW_COUNT_PER_FRAME * MeshObject::MAX_DESCRIPTOR_COUNT_FOR_DRAW);
-			// Create the constant buffer manager.
-			m_constantBufferManager[i][j] = new ConstantBufferManager;
-			m_constantBufferManager[i][j]->Initialize(m_device, MAX_DRAW_COUNT_PER_FRAME);
-			// Create the command context.
-			m_cmdCtx[i][j] = new CommandContext;
-			m_cmdCtx[i][j]->Initialize(m_device, 32);
-		}
+		m_descriptorPool[i] = new DescriptorPool*[m_renderThreadCount];
+		m_constantBufferPool[i] = new ConstantBufferPool*[m_renderThreadCount];
+		m_instanceBufferPool[i] = new InstanceBufferPool*[m_renderThreadCount];
+		m_cmdCtx[i] = new CommandContext*[m_renderThreadCount];
+		memset(m_descriptorPool[i], 0, sizeof(DescriptorPool*) * m_renderThreadCount);
+		memset(m_constantBufferPool[i], 0, sizeof(ConstantBufferPool*) * m_renderThreadCount);
+		memset(m_instanceBufferPool[i], 0, sizeof(InstanceBufferPool*) * m_renderThreadCount);
+		memset(m_cmdCtx[i], 0, sizeof(CommandContext*) * m_renderThreadCount);
 	}
+	// The other threads' pools are created the first frame they record.
+	CreateThreadResources(1);
 	// Create the font manager.
 	m_fontManager = new FontManager;
 	m_fontManager->Initialize(this, m_cmdQueue, 1024, 256, enableDebugLayer);
@@ -159,12 +173,34 @@ bool Renderer::Initialize(HWND hwnd, bool enableDebugLayer, bool enableGBV)
 	// Create the texture manager.
 	m_textureManager = new TextureManager;
 	m_textureManager->Initialize(this);
-	// Create the render queue.
-	for (uint32 i = 0; i < m_renderThreadCount; i++)
+	// Create the render queues shared by all render threads. One is filled while the other is recorded.
+	for (uint32 i = 0; i < RENDER_QUEUE_COUNT; i++)
 	{
-		m_renderQueue[i] = new RenderQueue;
-		m_renderQueue[i]->Initialize(m_device, 8192);
+		m_renderQueues[i] = new RenderQueue;
+		m_renderQueues[i]->Initialize(m_device, INITIAL_JOB_COUNT, m_renderThreadCount);
 	}
+	m_renderQueue = m_renderQueues[0];
+	m_recordQueue = m_renderQueues[0];
+	// Create the task graph the frame is recorded with.
+	m_frameGraph = new TaskGraph;
+	static_assert(SORT_PASS_COUNT == RadixSort::PASS_COUNT, "one context per radix pass");
+	for (uint32 i = 0; i < SORT_PASS_COUNT; i++)
+	{
+		m_sortPassContexts[i].renderer = this;
+		m_sortPassContexts[i].pass = i;
+	}
+	// Starts the render threads and the frame thread when on.
+	SetMultiThreadRendering(MULTI_THREAD_RENDERING != 0);
+	SetPipelinedFrames(PIPELINED_FRAMES != 0);
+#ifdef _DEBUG
+	// IT_Renderer has no capture call. In debug builds a file name in RENDERER_CAPTURE_FILE captures every frame into it.
+	wchar_t captureFilename[MAX_PATH] = {};
+	DWORD captureFilenameLength = GetEnvironmentVariableW(L"RENDERER_CAPTURE_FILE", captureFilename, MAX_PATH);
+	if (captureFilenameLength && captureFilenameLength < MAX_PATH)
+	{
+		BeginCapture(captureFilename);
+	}
+#endif
 
 	RECT rect = {};
 	::GetClientRect(hwnd, &rect);
@@ -246,8 +282,6 @@ bool Renderer::Initialize(HWND hwnd, bool enableDebugLayer, bool enableGBV)
 	// Create dsv descriptor heap.
 	CreateDescriptorHeapForDsv();
 	CreateDepthStencilView(screenWidth, screenHeight);
-	// Create the fence.
-	CreateFence();
 	// Initialize the camera.
 	InitCamera();
 
@@ -271,6 +305,67 @@ bool Renderer::Initialize(HWND hwnd, bool enableDebugLayer, bool enableGBV)
 }
 
 void Renderer::BeginRender()
+{
+	// A pipelined frame is opened on the frame thread.
+	if (!m_pipelinedFrames)
+	{
+		BeginFrame();
+	}
+}
+
+void Renderer::EndRender()
+{
+	if (m_pipelinedFrames)
+	{
+		// The pipeline is full while the previous frame is still recording.
+		if (m_frameThread->IsBusy())
+		{
+			m_pipelineStallCount++;
+		}
+		m_frameThread->WaitForCompletion();
+	}
+
+	CommandContext* cmdCtx = m_cmdCtx[m_framePendingIdx][0];
+
+	// Dynamic textures are copied once here, and executed ahead of every list that samples them.
+	m_textureUploadBytes = 0;
+	if (m_textureManager->HasDirtyTextures())
+	{
+		m_textureUploadBytes = m_textureManager->UploadDirtyTextures(cmdCtx->GetCurrentCommandList(), m_framePendingIdx);
+		cmdCtx->CloseAndExcute(m_cmdQueue);
+	}
+
+	if (m_renderCapture)
+	{
+		m_renderCapture->WriteFrame(m_renderQueue, m_viewRow, m_projRow);
+	}
+
+	// Hand the frame off, the Render calls fill the other queue from here on.
+	m_recordQueue = m_renderQueue;
+	m_renderQueueIdx = (m_renderQueueIdx + 1) % RENDER_QUEUE_COUNT;
+	m_renderQueue = m_renderQueues[m_renderQueueIdx];
+	m_frameViewRow = m_viewRow;
+	m_frameProjRow = m_projRow;
+
+	if (m_pipelinedFrames)
+	{
+		m_frameThread->DispatchAsync(1);
+	}
+	else
+	{
+		RecordFrame();
+	}
+}
+
+void Renderer::Present()
+{
+	if (!m_pipelinedFrames)
+	{
+		PresentFrame();
+	}
+}
+
+void Renderer::BeginFrame()
 {
 	CommandContext* cmdCtx = m_cmdCtx[m_framePendingIdx][0];
 	ID3D12GraphicsCommandList* cmdList = cmdCtx->GetCurrentCommandList();
@@ -289,26 +384,90 @@ void Renderer::BeginRender()
 	Fence();
 }
 
-void Renderer::EndRender()
+void Renderer::RecordFrame()
 {
 	CommandContext* cmdCtx = m_cmdCtx[m_framePendingIdx][0];
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart(), m_frameIdx, m_rtvDescriptorSize);
 	CD3DX12_CPU_DESCRIPTOR_HANDLE dsvHandle(m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
 
-#if MULTI_THREAD_RENDERING
-	m_activeThreadCount = m_renderThreadCount;
-	for (uint32 i = 0; i < m_renderThreadCount; i++)
+	uint32 jobCount = m_recordQueue->GetJobCount();
+	m_activeThreadCount = GetRecordThreadCount(jobCount);
+	CreateThreadResources(m_activeThreadCount);
+	WriteFrameConstants();
+	m_recordFrameCount++;
+
+	bool multiThread = m_multiThreadRendering && m_activeThreadCount > 1;
+
+	// Without stealing every slot records its own share with its own constant buffers and descriptors.
+	m_stealWork = multiThread;
+
+	// gather keys (parallel for) -> count, scatter for every radix pass (parallel for each) -> split
+	// -> record slots (parallel for) -> submit
+	uint32 gatherCount = m_recordQueue->PrepareSort();
+	uint32 sortBlockCount = m_recordQueue->GetSortBlockCount();
+	m_frameGraph->Reset();
+	uint32 gatherTask = m_frameGraph->AddTask(Renderer::GatherSortKeysTask, this, gatherCount);
+	uint32 prevTask = gatherTask;
+	for (uint32 pass = 0; pass < SORT_PASS_COUNT; pass++)
+	{
+		uint32 countTask = m_frameGraph->AddTask(Renderer::CountSortBlockTask, &m_sortPassContexts[pass], sortBlockCount);
+		uint32 scatterTask = m_frameGraph->AddTask(Renderer::ScatterSortBlockTask, &m_sortPassContexts[pass], sortBlockCount);
+		m_frameGraph->AddDependency(countTask, prevTask);
+		m_frameGraph->AddDependency(scatterTask, countTask);
+		prevTask = scatterTask;
+	}
+	uint32 sortTask = m_frameGraph->AddTask(Renderer::SortTask, this, 1);
+	uint32 recordTask = m_frameGraph->AddTask(Renderer::RecordTask, this, m_activeThreadCount);
+	uint32 submitTask = m_frameGraph->AddTask(Renderer::SubmitTask, this, 1);
+	m_frameGraph->AddDependency(sortTask, prevTask);
+	m_frameGraph->AddDependency(recordTask, sortTask);
+	m_frameGraph->AddDependency(submitTask, recordTask);
+
+	LARGE_INTEGER beginCounter = {};
+	QueryPerformanceCounter(&beginCounter);
+
+	if (multiThread)
 	{
-		SetEvent(m_threadDesc[i].threadEvent[static_cast<uint32>(RENDER_THREAD_EVENT_TYPE::RENDER_THREAD_PROCESS)]);
+		m_threadPool->Dispatch(m_activeThreadCount);
 	}
-	WaitForSingleObject(m_completeThread, INFINITE);
-#else
-	for (uint32 i = 0; i < m_renderThreadCount; i++)
+	else
 	{
-		m_renderQueue[i]->Process(i, cmdCtx, m_cmdQueue, 400, rtvHandle, dsvHandle, m_viewPort, m_scissorRect);
+		m_frameGraph->Run();
 	}
-#endif
+
+	LARGE_INTEGER endCounter = {};
+	QueryPerformanceCounter(&endCounter);
+
+	m_descriptorRing->EndFrame(m_framePendingIdx);
+
+	if (jobCount)
+	{
+		float recordTime = static_cast<float>(endCounter.QuadPart - beginCounter.QuadPart) * 1000000.0f / m_counterFrequency;
+		float threadTime = multiThread ? recordTime * m_activeThreadCount : recordTime;
+		m_recordTimePerJob += (threadTime / jobCount - m_recordTimePerJob) * 0.1f;
+	}
+
+	m_constantWriteBytes = 0;
+	m_persistentConstantHitCount = 0;
+	m_persistentConstantMissCount = 0;
+	m_descriptorCopyCount = 0;
+	m_descriptorCopyCallCount = 0;
+	m_descriptorTableHitCount = 0;
+	m_descriptorTableMissCount = 0;
+	for (uint32 i = 0; i < m_threadResourceCount; i++)
+	{
+		ConstantBufferPool* cbPool = m_constantBufferPool[m_framePendingIdx][i];
+		m_constantWriteBytes += cbPool->GetRequestedSize();
+		m_persistentConstantHitCount += cbPool->GetPersistentHitCount();
+		m_persistentConstantMissCount += cbPool->GetPersistentMissCount();
+		DescriptorPool* descPool = m_descriptorPool[m_framePendingIdx][i];
+		m_descriptorCopyCount += descPool->GetCopyCount();
+		m_descriptorCopyCallCount += descPool->GetCopyCallCount();
+		m_descriptorTableHitCount += descPool->GetTableHitCount();
+		m_descriptorTableMissCount += descPool->GetTableMissCount();
+	}
+	m_constantWriteBytes += static_cast<uint64>(m_persistentConstantMissCount) * sizeof(OBJECT_CONST_DATA);
 
 	ID3D12GraphicsCommandList* cmdList = cmdCtx->GetCurrentCommandList();
 	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_backBufferRtv[m_frameIdx], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
@@ -316,10 +475,26 @@ void Renderer::EndRender()
 	cmdCtx->CloseAndExcute(m_cmdQueue);
 }
 
-void Renderer::Present()
+void Renderer::WriteFrameConstants()
 {
-	static uint32 count = 0;
+	// Written before any slot records, so slot 0's pool is free to use. Every slot's draws read the same copy.
+	ConstantBufferPool* cbPool = m_constantBufferPool[m_framePendingIdx][0];
+	uint8* cbPtr = cbPool->Alloc(sizeof(FRAME_CONST_DATA), &m_frameConstAddr);
+	if (!cbPtr)
+	{
+		__debugbreak();
+	}
+
+	FRAME_CONST_DATA cbData = {};
+	cbData.view = m_frameViewRow.Transpose();
+	cbData.projection = m_frameProjRow.Transpose();
+	cbData.viewProjection = (m_frameViewRow * m_frameProjRow).Transpose();
+	ConstantWriter::Write(cbPtr, &cbData, sizeof(FRAME_CONST_DATA));
+	ConstantWriter::Flush();
+}
 
+void Renderer::PresentFrame()
+{
 	Fence();
 
 	uint32 syncInterval = m_syncInterval;
@@ -338,13 +513,15 @@ void Renderer::Present()
 
 	WaitForGpu(m_fenceFramePendingValue[framePendingIdx]);
 
-	for (uint32 threadIdx = 0; threadIdx < m_renderThreadCount; threadIdx++)
+	m_descriptorRing->Retire(framePendingIdx);
+	for (uint32 threadIdx = 0; threadIdx < m_threadResourceCount; threadIdx++)
 	{
 		m_descriptorPool[framePendingIdx][threadIdx]->Free();
-		m_constantBufferManager[framePendingIdx][threadIdx]->Free();
+		m_constantBufferPool[framePendingIdx][threadIdx]->Free();
+		m_instanceBufferPool[framePendingIdx][threadIdx]->Free();
 		m_cmdCtx[framePendingIdx][threadIdx]->Free();
-		m_renderQueue[threadIdx]->Free();
 	}
+	m_recordQueue->Free();
 
 	m_framePendingIdx = framePendingIdx;
 }
@@ -448,7 +625,6 @@ void Renderer::UpdateTextureWidthImage(void* textureHandle, const uint8* srcImag
 {
 	TEXTURE_HANDLE* texHandle = reinterpret_cast<TEXTURE_HANDLE*>(textureHandle);
 	ID3D12Resource* texResource = texHandle->textureResource;
-	ID3D12Resource* upBuffer = texHandle->uploadBuffer;
 	D3D12_RESOURCE_DESC texDesc = texResource->GetDesc();
 
 	if (srcWidth > texDesc.Width)
@@ -467,13 +643,9 @@ void Renderer::UpdateTextureWidthImage(void* textureHandle, const uint8* srcImag
 
 	m_device->GetCopyableFootprints(&texDesc, 0, 1, 0, &footPrint, &rows, &rowSize, &totalBytes);
 
-	uint8* mappedPtr = nullptr;
-	CD3DX12_RANGE writeRange(0, 0);
-
-	ThrowIfFailed(upBuffer->Map(0, &writeRange, reinterpret_cast<void**>(&mappedPtr)));
-
+	// Only the CPU copy is written here. UploadDirtyTextures moves it into the upload buffer of the frame that copies it.
 	const uint8* src = srcImage;
-	uint8* dest = mappedPtr;
+	uint8* dest = texHandle->image;
 	for (uint32 h = 0; h < srcHeight; h++)
 	{
 		memcpy(dest, src, srcWidth * 4);
@@ -481,7 +653,7 @@ void Renderer::UpdateTextureWidthImage(void* textureHandle, const uint8* srcImag
 		dest += footPrint.Footprint.RowPitch;
 	}
 
-	upBuffer->Unmap(0, nullptr);
+	m_textureManager->MarkDirty(texHandle);
 }
 
 void Renderer::DestroyFontObject(void* fontObj)
@@ -497,6 +669,12 @@ void Renderer::DestroyTexture(void* textureHandle)
 {
 	TEXTURE_HANDLE* texHandle = reinterpret_cast<TEXTURE_HANDLE*>(textureHandle);
 
+	// The frame thread may still be recording draws of the texture, and the GPU reading its descriptor.
+	if (m_pipelinedFrames)
+	{
+		GpuCompleted();
+	}
+
 	m_textureManager->DestroyTexture(texHandle);
 }
 
@@ -504,31 +682,23 @@ void Renderer::RenderMeshObject(IT_MeshObject* obj, Matrix worldRow, bool isWire
 {
 	MeshObject* meshObj = reinterpret_cast<MeshObject*>(obj);
 
-	RENDER_JOB job = {};
-	job.type = RENDER_JOB_TYPE::RENDER_MESH_OBJECT;
-	job.obj = meshObj;
-	job.mesh.worldRow = worldRow;
-	job.mesh.isWire = isWire;
-	m_renderQueue[m_threadIdx]->Add(&job);
-
-	m_threadIdx = (m_threadIdx + 1) % m_renderThreadCount;
+	uint64 sortKey = RenderQueue::MakeSortKey(isWire ? RENDER_PIPELINE_TYPE::MESH_WIRE_PIPELINE : RENDER_PIPELINE_TYPE::MESH_DEFAULT_PIPELINE, meshObj->GetTextureId(), meshObj->GetMeshId(), GetNormalizedViewDepth(worldRow));
+	m_renderQueue->AddMeshJob(sortKey, meshObj, worldRow, isWire);
 }
 
 void Renderer::RenderSpriteObject(IT_SpriteObject* obj, uint32 posX, uint32 posY, float scaleX, float scaleY, float z)
 {
 	SpriteObject* spriteObj = reinterpret_cast<SpriteObject*>(obj);
 
-	RENDER_JOB job = {};
-	job.type = RENDER_JOB_TYPE::RENDER_SPRITE_OBJECT;
-	job.obj = spriteObj;
-	job.sprite.posX = posX;
-	job.sprite.posY = posY;
-	job.sprite.scaleX = scaleX;
-	job.sprite.scaleY = scaleY;
-	job.sprite.z = z;
-	m_renderQueue[m_threadIdx]->Add(&job);
+	SPRITE_RENDER_JOB spriteJob = {};
+	spriteJob.posX = posX;
+	spriteJob.posY = posY;
+	spriteJob.scaleX = scaleX;
+	spriteJob.scaleY = scaleY;
+	spriteJob.z = z;
 
-	m_threadIdx = (m_threadIdx + 1) % m_renderThreadCount;
+	uint64 sortKey = RenderQueue::MakeSortKey(RENDER_PIPELINE_TYPE::SPRITE_PIPELINE, 0, 0, z);
+	m_renderQueue->AddSpriteJob(sortKey, spriteObj, &spriteJob);
 }
 
 void Renderer::RenderSpriteObjectWithTexture(IT_SpriteObject* obj, uint32 posX, uint32 posY, float scaleX, float scaleY, float z, const RECT* rect, void* textureHandle)
@@ -536,38 +706,36 @@ void Renderer::RenderSpriteObjectWithTexture(IT_SpriteObject* obj, uint32 posX,
 	SpriteObject* spriteObj = reinterpret_cast<SpriteObject*>(obj);
 	TEXTURE_HANDLE* texHandle = reinterpret_cast<TEXTURE_HANDLE*>(textureHandle);
 
-	RENDER_JOB job = {};
-	job.type = RENDER_JOB_TYPE::RENDER_SPRITE_OBJECT;
-	job.obj = spriteObj;
-	job.sprite.posX = posX;
-	job.sprite.posY = posY;
-	job.sprite.scaleX = scaleX;
-	job.sprite.scaleY = scaleY;
-	job.sprite.z = z;
-	job.sprite.rect = rect;
-	job.sprite.texHandle = texHandle;
-	m_renderQueue[m_threadIdx]->Add(&job);
+	SPRITE_RENDER_JOB spriteJob = {};
+	spriteJob.posX = posX;
+	spriteJob.posY = posY;
+	spriteJob.scaleX = scaleX;
+	spriteJob.scaleY = scaleY;
+	spriteJob.z = z;
+	// Copy the rect, the caller's storage is not guaranteed to live until EndRender.
+	if (rect)
+	{
+		spriteJob.hasRect = true;
+		spriteJob.rect = *rect;
+	}
+	spriteJob.texHandle = texHandle;
 
-	m_threadIdx = (m_threadIdx + 1) % m_renderThreadCount;
+	uint64 sortKey = RenderQueue::MakeSortKey(RENDER_PIPELINE_TYPE::SPRITE_PIPELINE, 0, 0, z);
+	m_renderQueue->AddSpriteJob(sortKey, spriteObj, &spriteJob);
 }
 
 void Renderer::RenderLineObject(IT_LineObject* obj, Matrix worldRow)
 {
 	LineObject* lineObject = reinterpret_cast<LineObject*>(obj);
 
-	RENDER_JOB job = {};
-	job.type = RENDER_JOB_TYPE::RENDER_LINE_OBJECT;
-	job.obj = lineObject;
-	job.mesh.worldRow = worldRow;
-	m_renderQueue[m_threadIdx]->Add(&job);
-
-	m_threadIdx = (m_threadIdx + 1) % m_renderThreadCount;
+	uint64 sortKey = RenderQueue::MakeSortKey(RENDER_PIPELINE_TYPE::LINE_PIPELINE, 0, 0, GetNormalizedViewDepth(worldRow));
+	m_renderQueue->AddLineJob(sortKey, lineObject, worldRow);
 }
 
 void Renderer::GetViewProjMatrix(Matrix* viewMat, Matrix* projMat)
 {
-	*viewMat = m_viewRow.Transpose();
-	*projMat = m_projRow.Transpose();
+	*viewMat = m_frameViewRow.Transpose();
+	*projMat = m_frameProjRow.Transpose();
 }
 
 void Renderer::InitCamera()
@@ -605,14 +773,110 @@ void Renderer::SetCameraRot(const Vector3 dir)
 
 void Renderer::GpuCompleted()
 {
+	if (m_frameThread)
+	{
+		m_frameThread->WaitForCompletion();
+	}
 	for (uint32 i = 0; i < FRAME_PENDING_COUNT; i++)
 	{
 		WaitForGpu(m_fenceFramePendingValue[i]);
 	}
 }
 
+uint64 Renderer::GetConstantBufferResidentBytes()
+{
+	uint64 residentBytes = 0;
+	for (uint32 i = 0; i < FRAME_PENDING_COUNT; i++)
+	{
+		for (uint32 j = 0; j < m_threadResourceCount; j++)
+		{
+			residentBytes += m_constantBufferPool[i][j]->GetResidentSize();
+		}
+	}
+	return residentBytes;
+}
+
+uint32 Renderer::GetShaderVisibleDescriptorCount()
+{
+	return m_descriptorAllocator->GetShaderVisibleCount();
+}
+
+uint32 Renderer::GetTransientDescriptorCount()
+{
+	return m_descriptorRing->GetReservedCount();
+}
+
+uint32 Renderer::GetTransientDescriptorHighWaterMark()
+{
+	return m_descriptorRing->GetHighWaterMark();
+}
+
+uint32 Renderer::GetDescriptorRingWaitCount()
+{
+	return m_descriptorRing->GetWaitCount();
+}
+
+bool Renderer::BeginCapture(const wchar_t* filename)
+{
+	EndCapture();
+
+	m_renderCapture = new RenderCapture;
+	if (!m_renderCapture->Initialize(filename))
+	{
+		EndCapture();
+		return false;
+	}
+
+	return true;
+}
+
+void Renderer::EndCapture()
+{
+	if (m_renderCapture)
+	{
+		delete m_renderCapture;
+		m_renderCapture = nullptr;
+	}
+}
+
+void Renderer::SetMultiThreadRendering(bool enable)
+{
+	// The workers are only started the first time they are needed.
+	if (enable && !m_threadPool)
+	{
+		CreateThreadPool(m_renderThreadCount);
+	}
+
+	m_multiThreadRendering = enable;
+}
+
+void Renderer::SetPipelinedFrames(bool enable)
+{
+	if (enable && !m_frameThread)
+	{
+		m_frameThread = new RenderThreadPool;
+		m_frameThread->Initialize(1, Renderer::RenderFrameByFrameThread, this);
+	}
+	if (!enable && m_frameThread)
+	{
+		m_frameThread->WaitForCompletion();
+	}
+
+	m_pipelinedFrames = enable;
+}
+
 void Renderer::CleanUp()
 {
+	// Let the frame in flight finish before anything it uses goes away.
+	if (m_frameThread)
+	{
+		m_frameThread->WaitForCompletion();
+		delete m_frameThread;
+		m_frameThread = nullptr;
+	}
+
+	EndCapture();
+
 	Fence();
 	for (uint32 i = 0; i < FRAME_PENDING_COUNT; i++)
 	{
@@ -650,14 +914,21 @@ void Renderer::CleanUp()
 		m_cmdQueue->Release();
 		m_cmdQueue = nullptr;
 	}
-	for (uint32 i = 0; i < m_renderThreadCount; i++)
+	for (uint32 i = 0; i < RENDER_QUEUE_COUNT; i++)
 	{
-		if (m_renderQueue[i])
+		if (m_renderQueues[i])
 		{
-			delete m_renderQueue[i];
-			m_renderQueue[i] = nullptr;
+			delete m_renderQueues[i];
+			m_renderQueues[i] = nullptr;
 		}
 	}
+	m_renderQueue = nullptr;
+	m_recordQueue = nullptr;
+	if (m_frameGraph)
+	{
+		delete m_frameGraph;
+		m_frameGraph = nullptr;
+	}
 	if (m_textureManager)
 	{
 		delete m_textureManager;
@@ -673,30 +944,20 @@ void Renderer::CleanUp()
 		delete m_fontManager;
 		m_fontManager = nullptr;
 	}
-	for (uint32 i = 0; i < FRAME_PENDING_COUNT; i++)
-	{
-		for (uint32 j = 0; j < m_renderThreadCount; j++)
-		{
-			if (m_cmdCtx[i][j])
-			{
-				delete m_cmdCtx[i][j];
-				m_cmdCtx[i][j] = nullptr;
-			}
-			if (m_constantBufferManager[i][j])
-			{
-				delete m_constantBufferManager[i][j];
-				m_constantBufferManager[i][j] = nullptr;
-			}
-			if (m_descriptorPool[i])
-			{
-				delete m_descriptorPool[i][j];
-				m_descriptorPool[i][j] = nullptr;
-			}
-		}
-	}
+	DestroyThreadResources();
 
 	DestroyThreadPool();
 
+	if (m_persistentConstantPool)
+	{
+		delete m_persistentConstantPool;
+		m_persistentConstantPool = nullptr;
+	}
+	if (m_descriptorRing)
+	{
+		delete m_descriptorRing;
+		m_descriptorRing = nullptr;
+	}
 	if (m_descriptorAllocator)
 	{
 		delete m_descriptorAllocator;
@@ -807,21 +1068,55 @@ void Renderer::CreateFence()
 
 void Renderer::CreateThreadPool(uint32 threadCount)
 {
-	m_threadDesc = new RENDER_THREAD_DESC[threadCount];
+	m_threadPool = new RenderThreadPool;
+	m_threadPool->Initialize(threadCount, Renderer::RunFrameGraphByRenderThread, this);
+}
 
-	for (uint32 i = 0; i < threadCount; i++)
+void Renderer::CreateThreadResources(uint32 threadCount)
+{
+	for (uint32 j = m_threadResourceCount; j < threadCount; j++)
 	{
-		for (uint32 j = 0; j < static_cast<uint32>(RENDER_THREAD_EVENT_TYPE::RENDER_THREAD_TYPE_COUNT); j++)
+		for (uint32 i = 0; i < FRAME_PENDING_COUNT; i++)
 		{
-			m_threadDesc[i].threadEvent[j] = CreateEvent(nullptr, false, false, nullptr);
+			// Create the desciptor pool.
+			m_descriptorPool[i][j] = new DescriptorPool;
+			m_descriptorPool[i][j]->Initialize(m_device, m_descriptorRing);
+			// Create the constant buffer pool.
+			m_constantBufferPool[i][j] = new ConstantBufferPool;
+			m_constantBufferPool[i][j]->Initialize(m_device, INITIAL_CONSTANT_BUFFER_SIZE_PER_FRAME);
+			// Create the instance buffer pool.
+			m_instanceBufferPool[i][j] = new InstanceBufferPool;
+			m_instanceBufferPool[i][j]->Initialize(m_device, INSTANCE_BUFFER_SIZE_PER_FRAME);
+			// Create the command context.
+			m_cmdCtx[i][j] = new CommandContext;
+			m_cmdCtx[i][j]->Initialize(m_device, RenderQueue::INITIAL_COMMAND_LIST_COUNT_PER_THREAD);
 		}
-		uint32 threadId = 0;
-		m_threadDesc[i].renderBody = this;
-		m_threadDesc[i].threadIdx = i;
-		m_threadDesc[i].threadHandle = reinterpret_cast<HANDLE>(_beginthreadex(nullptr, 0, RenderThread::ProcessByRenderThread, m_threadDesc + i, 0, &threadId));
 	}
 
-	m_completeThread = CreateEvent(nullptr, false, false, nullptr);
+	if (threadCount > m_threadResourceCount)
+	{
+		m_threadResourceCount = threadCount;
+	}
+}
+
+uint32 Renderer::GetRecordThreadCount(uint32 jobCount)
+{
+	// Enough workers that each records about TARGET_RECORD_TIME_PER_THREAD at the measured cost per job.
+	uint32 threadCount = static_cast<uint32>(m_recordTimePerJob * jobCount / TARGET_RECORD_TIME_PER_THREAD) + 1;
+
+	// Waking a worker for a handful of jobs costs more than it saves.
+	uint32 maxThreadCount = jobCount / MIN_JOB_COUNT_PER_THREAD + 1;
+	if (threadCount > maxThreadCount)
+	{
+		threadCount = maxThreadCount;
+	}
+
+	if (threadCount > m_renderThreadCount)
+	{
+		threadCount = m_renderThreadCount;
+	}
+
+	return threadCount;
 }
 
 void Renderer::DestroyDescriptorHeapForRtv()
@@ -865,30 +1160,64 @@ void Renderer::DestroyFence()
 	}
 }
 
-void Renderer::DestroyThreadPool()
+void Renderer::DestroyThreadResources()
 {
-	if (m_threadDesc)
+	for (uint32 i = 0; i < FRAME_PENDING_COUNT; i++)
 	{
-		for (uint32 i = 0; i < m_renderThreadCount; i++)
+		for (uint32 j = 0; j < m_threadResourceCount; j++)
 		{
-			SetEvent(m_threadDesc[i].threadEvent[static_cast<uint32>(RENDER_THREAD_EVENT_TYPE::RENDER_THREAD_EXIT)]);
-			WaitForSingleObject(m_threadDesc[i].threadHandle, INFINITE);
-
-			for (uint32 j = 0; j < static_cast<uint32>(RENDER_THREAD_EVENT_TYPE::RENDER_THREAD_TYPE_COUNT); j++)
+			if (m_cmdCtx[i][j])
 			{
-				if (m_threadDesc[i].threadEvent[j])
-				{
-					CloseHandle(m_threadDesc[i].threadEvent[j]);
-				}
+				delete m_cmdCtx[i][j];
+				m_cmdCtx[i][j] = nullptr;
+			}
+			if (m_constantBufferPool[i][j])
+			{
+				delete m_constantBufferPool[i][j];
+				m_constantBufferPool[i][j] = nullptr;
 			}
-			if (m_threadDesc[i].threadHandle)
+			if (m_instanceBufferPool[i][j])
 			{
-				CloseHandle(m_threadDesc[i].threadHandle);
+				delete m_instanceBufferPool[i][j];
+				m_instanceBufferPool[i][j] = nullptr;
+			}
+			if (m_descriptorPool[i][j])
+			{
+				delete m_descriptorPool[i][j];
+				m_descriptorPool[i][j] = nullptr;
 			}
 		}
 
-		delete[] m_threadDesc;
-		m_threadDesc = nullptr;
+		if (m_cmdCtx[i])
+		{
+			delete[] m_cmdCtx[i];
+			m_cmdCtx[i] = nullptr;
+		}
+		if (m_constantBufferPool[i])
+		{
+			delete[] m_constantBufferPool[i];
+			m_constantBufferPool[i] = nullptr;
+		}
+		if (m_instanceBufferPool[i])
+		{
+			delete[] m_instanceBufferPool[i];
+			m_instanceBufferPool[i] = nullptr;
+		}
+		if (m_descriptorPool[i])
+		{
+			delete[] m_descriptorPool[i];
+			m_descriptorPool[i] = nullptr;
+		}
+	}
+	m_threadResourceCount = 0;
+}
+
+void Renderer::DestroyThreadPool()
+{
+	if (m_threadPool)
+	{
+		delete m_threadPool;
+		m_threadPool = nullptr;
 	}
 }
 
@@ -897,6 +1226,7 @@ void Renderer::Fence()
 	uint64 curFenceValue = ++m_fenceValue;
 	m_cmdQueue->Signal(m_fence, curFenceValue);
 	m_fenceFramePendingValue[m_framePendingIdx] = curFenceValue;
+	m_descriptorRing->SetFrameFenceValue(m_framePendingIdx, curFenceValue);
 }
 
 void Renderer::WaitForGpu(uint64 expectedValue)
@@ -909,6 +1239,12 @@ void Renderer::WaitForGpu(uint64 expectedValue)
 	}
 }
 
+float Renderer::GetNormalizedViewDepth(const Matrix& worldRow)
+{
+	Vector3 viewPos = Vector3::Transform(worldRow.Translation(), m_viewRow);
+	return viewPos.z / CAMERA_FAR_Z;
+}
+
 void Renderer::SetCamera(Vector3 camPos, Vector3 camDir)
 {
 	m_camPos = camPos;
@@ -919,10 +1255,8 @@ void Renderer::SetCamera(Vector3 camPos, Vector3 camDir)
 
 	constexpr float fov = XMConvertToRadians(70.0f);
 	float aspect = GetAspectRatio();
-	float nearZ = 0.01f;
-	float farZ = 1000.0f;
 
-	m_projRow = XMMatrixPerspectiveFovLH(fov, aspect, nearZ, farZ);
+	m_projRow = XMMatrixPerspectiveFovLH(fov, aspect, CAMERA_NEAR_Z, CAMERA_FAR_Z);
 }
 
 void Renderer::SetCamera(float x, float y, float z, float dirX, float dirY, float dirZ)
@@ -1068,7 +1402,7 @@ uint32 Renderer::GetCmdListCount()
 	uint32 totalCount = 0;
 	for (uint32 i = 0; i < FRAME_PENDING_COUNT; i++)
 	{
-		for (uint32 j = 0; j < m_renderThreadCount; j++)
+		for (uint32 j = 0; j < m_threadResourceCount; j++)
 		{
 			totalCount += m_cmdCtx[i][j]->GetCmdListCount();
 		}
@@ -1082,18 +1416,64 @@ Process
 ===================
 */
 
+void Renderer::RunFrameGraphByRenderThread(void* context, uint32 threadIdx)
+{
+	Renderer* renderer = reinterpret_cast<Renderer*>(context);
+	renderer->m_frameGraph->Run();
+}
+
+void Renderer::RenderFrameByFrameThread(void* context, uint32 threadIdx)
+{
+	Renderer* renderer = reinterpret_cast<Renderer*>(context);
+	renderer->BeginFrame();
+	renderer->RecordFrame();
+	renderer->PresentFrame();
+}
+
 void Renderer::Process(uint32 threadIdx)
 {
 	CommandContext* cmdCtx = m_cmdCtx[m_framePendingIdx][threadIdx];
+	DescriptorPool* descPool = m_descriptorPool[m_framePendingIdx][threadIdx];
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart(), m_frameIdx, m_rtvDescriptorSize);
 	CD3DX12_CPU_DESCRIPTOR_HANDLE dsvHandle(m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
 
-	m_renderQueue[threadIdx]->Process(threadIdx, cmdCtx, m_cmdQueue, 400, rtvHandle, dsvHandle, m_viewPort, m_scissorRect);
+	m_recordQueue->Process(threadIdx, cmdCtx, descPool, 400, rtvHandle, dsvHandle, m_viewPort, m_scissorRect, m_stealWork);
+}
 
-	uint64 curThreadCount = _InterlockedDecrement(&m_activeThreadCount);
-	if (curThreadCount == 0)
-	{
-		SetEvent(m_completeThread);
-	}
+void Renderer::GatherSortKeysTask(void* context, uint32 itemIdx)
+{
+	Renderer* renderer = reinterpret_cast<Renderer*>(context);
+	renderer->m_recordQueue->GatherSortKeys(itemIdx);
+}
+
+void Renderer::CountSortBlockTask(void* context, uint32 itemIdx)
+{
+	SORT_PASS_TASK_CONTEXT* passContext = reinterpret_cast<SORT_PASS_TASK_CONTEXT*>(context);
+	passContext->renderer->m_recordQueue->CountSortBlock(passContext->pass, itemIdx);
+}
+
+void Renderer::ScatterSortBlockTask(void* context, uint32 itemIdx)
+{
+	SORT_PASS_TASK_CONTEXT* passContext = reinterpret_cast<SORT_PASS_TASK_CONTEXT*>(context);
+	passContext->renderer->m_recordQueue->ScatterSortBlock(passContext->pass, itemIdx);
+}
+
+void Renderer::SortTask(void* context, uint32 itemIdx)
+{
+	Renderer* renderer = reinterpret_cast<Renderer*>(context);
+	renderer->m_recordQueue->SortAndSplit(renderer->m_activeThreadCount);
+}
+
+void Renderer::RecordTask(void* context, uint32 itemIdx)
+{
+	// One item per recording slot, each slot uses its own command context and pools.
+	Renderer* renderer = reinterpret_cast<Renderer*>(context);
+	renderer->Process(itemIdx);
+}
+
+void Renderer::SubmitTask(void* context, uint32 itemIdx)
+{
+	Renderer* renderer = reinterpret_cast<Renderer*>(context);
+	renderer->m_recordQueue->Submit(renderer->m_cmdQueue);
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+// Build time defaults. IT_Renderer has no switch for them, SetMultiThreadRendering and SetPipelinedFrames still change them at run time.
 #define MULTI_THREAD_RENDERING 0
+#define PIPELINED_FRAMES 0
 
 #include "../../Interface/IT_Renderer.h"
 
@@ -13,20 +15,42 @@ Renderer
 class FontManager;
 class ResourceManager;
 class TextureManager;
-class ConstantBufferManager;
+class ConstantBufferPool;
+class InstanceBufferPool;
 class DescriptorAllocator;
+class DescriptorRing;
 class DescriptorPool;
 class CommandContext;
 class RenderQueue;
+class PersistentConstantPool;
+class RenderCapture;
+class RenderThreadPool;
+class TaskGraph;
+class Renderer;
+
+// Context of the radix pass tasks of the frame graph, one per pass.
+struct SORT_PASS_TASK_CONTEXT
+{
+	Renderer* renderer = nullptr;
+	uint32 pass = 0;
+};
 
 class Renderer : public IT_Renderer
 {
 public:
 	static const uint32 FRAME_COUNT = 3;
 	static const uint32 FRAME_PENDING_COUNT = 2;
-	static const uint32 MAX_THREAD_COUNT = 8;
+	static const uint32 RENDER_QUEUE_COUNT = 2;
+	static const uint32 SORT_PASS_COUNT = 8;		// RadixSort::PASS_COUNT
 	static const uint32 MAX_DESCRIPTOR_COUNT = 4096;
-	static const uint32 MAX_DRAW_COUNT_PER_FRAME = 4096;
+	static const uint32 MAX_DRAW_COUNT_PER_FRAME = 4096;		// for every thread together, sizes the shared descriptor ring
+	static const uint32 INSTANCE_BUFFER_SIZE_PER_FRAME = 2 * 1024 * 1024;
+	static const uint32 INITIAL_CONSTANT_BUFFER_SIZE_PER_FRAME = 64 * 1024;		// pools grow by pages past this
+	static const uint32 INITIAL_JOB_COUNT = 65536;
+	static const uint32 MIN_JOB_COUNT_PER_THREAD = 256;
+	static constexpr float TARGET_RECORD_TIME_PER_THREAD = 500.0f;	// microseconds
+	static constexpr float CAMERA_NEAR_Z = 0.01f;
+	static constexpr float CAMERA_FAR_Z = 1000.0f;
 
 	Renderer();
 	~Renderer();
@@ -74,18 +98,53 @@ public:
 	/*Inline*/
 	inline ID3D12Device5* GetDevice() { return m_device; }
 	inline ResourceManager* GetReourceManager() { return m_resourceManager; }
-	inline ConstantBufferManager* GetConstantBufferManager(uint32 threadIdx) { return m_constantBufferManager[m_framePendingIdx][threadIdx]; }
+	inline ConstantBufferPool* GetConstantBufferPool(uint32 threadIdx) { return m_constantBufferPool[m_framePendingIdx][threadIdx]; }
+	inline InstanceBufferPool* GetInstanceBufferPool(uint32 threadIdx) { return m_instanceBufferPool[m_framePendingIdx][threadIdx]; }
 	inline DescriptorAllocator* GetDescriptorAllocator() { return m_descriptorAllocator; }
 	inline DescriptorPool* GetDescriptorPool(uint32 threadIdx) { return m_descriptorPool[m_framePendingIdx][threadIdx]; }
 	inline uint32 GetScreenWidth() { return m_screenWidth; }
 	inline uint32 GetScreenHegiht() { return m_screenHeight; }
 	inline float GetAspectRatio() { return static_cast<float>(m_screenWidth) / m_screenHeight; }
 	inline float GetDpi() { return m_dpi; }
+	inline uint64 GetTextureUploadBytes() { return m_textureUploadBytes; }
+	inline uint64 GetConstantWriteBytes() { return m_constantWriteBytes; }
+	inline D3D12_GPU_VIRTUAL_ADDRESS GetFrameConstantBufferAddress() { return m_frameConstAddr; }
+	inline PersistentConstantPool* GetPersistentConstantPool() { return m_persistentConstantPool; }
+	inline uint32 GetPersistentConstantHitCount() { return m_persistentConstantHitCount; }
+	inline uint32 GetPersistentConstantMissCount() { return m_persistentConstantMissCount; }
+	inline uint32 GetDescriptorCopyCount() { return m_descriptorCopyCount; }
+	inline uint32 GetDescriptorCopyCallCount() { return m_descriptorCopyCallCount; }
+	inline uint32 GetDescriptorTableHitCount() { return m_descriptorTableHitCount; }
+	inline uint32 GetDescriptorTableMissCount() { return m_descriptorTableMissCount; }
+	inline uint32 GetFramePendingIdx() { return m_framePendingIdx; }
+	inline uint32 GetRecordFrameCount() { return m_recordFrameCount; }
+	inline uint32 GetPipelineStallCount() { return m_pipelineStallCount; }
+	inline uint32 GetActiveThreadCount() { return m_activeThreadCount; }
+	inline float GetRecordTimePerJob() { return m_recordTimePerJob; }
 
 	/*DLL Inner*/
 	void GetViewProjMatrix(Matrix* viewMat, Matrix* projMat);
 	void InitCamera();
 	void GpuCompleted();
+	// Upload memory held by every thread's constant buffer pools, used or not.
+	uint64 GetConstantBufferResidentBytes();
+	// Descriptors of the one shader visible heap, persistent slots and the transient ring together, used or not.
+	uint32 GetShaderVisibleDescriptorCount();
+	// Transient descriptors held by the frames in flight, and the most they held when a frame ended.
+	uint32 GetTransientDescriptorCount();
+	uint32 GetTransientDescriptorHighWaterMark();
+	// Times a recording thread found the ring full and waited for an older frame.
+	uint32 GetDescriptorRingWaitCount();
+	// Writes every following frame's jobs to filename until EndCapture. See RenderReplay for reading it back.
+	bool BeginCapture(const wchar_t* filename);
+	void EndCapture();
+	// Records the frame on the render threads when enabled. Submission order is the same either way.
+	void SetMultiThreadRendering(bool enable);
+	inline bool IsMultiThreadRendering() { return m_multiThreadRendering; }
+	// EndRender hands the frame to a frame thread that records and presents it, and Present returns right away.
+	// Switch it between Present and BeginRender only.
+	void SetPipelinedFrames(bool enable);
+	inline bool IsPipelinedFrames() { return m_pipelinedFrames; }
 
 private:
 	void CleanUp();
@@ -99,10 +158,25 @@ private:
 	void DestroyDepthStencilView();
 	void DestroyFence();
 	void DestroyThreadPool();
+	void CreateThreadResources(uint32 threadCount);
+	void DestroyThreadResources();
+	uint32 GetRecordThreadCount(uint32 jobCount);
+	void BeginFrame();
+	void RecordFrame();
+	void WriteFrameConstants();
+	void PresentFrame();
 	void Fence();
 	void WaitForGpu(uint64 expectedValue);
+	float GetNormalizedViewDepth(const Matrix& worldRow);
 
-	friend class RenderThread;
+	static void RunFrameGraphByRenderThread(void* context, uint32 threadIdx);
+	static void RenderFrameByFrameThread(void* context, uint32 threadIdx);
+	static void GatherSortKeysTask(void* context, uint32 itemIdx);
+	static void CountSortBlockTask(void* context, uint32 itemIdx);
+	static void ScatterSortBlockTask(void* context, uint32 itemIdx);
+	static void SortTask(void* context, uint32 itemIdx);
+	static void RecordTask(void* context, uint32 itemIdx);
+	static void SubmitTask(void* context, uint32 itemIdx);
 	void Process(uint32 threadIdx);
 
 private:
@@ -129,26 +203,53 @@ private:
 	uint32 m_rtvDescriptorSize = 0;
 	uint32 m_dsvDescriptorSize = 0;
 	uint64 m_fenceValue = 0;
+	uint64 m_textureUploadBytes = 0;		// copied by the upload pass of the last EndRender
+	uint64 m_constantWriteBytes = 0;		// constants written while recording the last frame
+	D3D12_GPU_VIRTUAL_ADDRESS m_frameConstAddr = 0;	// FRAME_CONST_DATA of the frame being recorded
+	uint32 m_persistentConstantHitCount = 0;		// draws of the last frame whose persistent constants were still valid
+	uint32 m_persistentConstantMissCount = 0;
+	uint32 m_descriptorCopyCount = 0;		// SRVs copied into the frame's descriptor pools, zero once every draw is bindless
+	uint32 m_descriptorCopyCallCount = 0;		// CopyDescriptors calls issuing them, at most one per command list unless a batch filled up
+	uint32 m_descriptorTableHitCount = 0;		// draws of the last frame that reused a table copied earlier in the frame
+	uint32 m_descriptorTableMissCount = 0;
+	uint32 m_recordFrameCount = 0;
+	uint32 m_pipelineStallCount = 0;		// hand-offs that waited for the previous frame
 	uint64 m_fenceFramePendingValue[FRAME_PENDING_COUNT] = {};
 	uint32 m_syncInterval = 0; // Vsync on:1/off:0
-	uint32 m_renderThreadCount = 0;
+	uint32 m_renderThreadCount = 0;		// one worker per physical core
+	uint32 m_activeThreadCount = 0;		// workers recording the current frame
+	uint32 m_threadResourceCount = 0;		// threads whose per frame pools exist
+	float m_recordTimePerJob = 2.0f;		// microseconds of thread time, smoothed over frames
+	uint64 m_counterFrequency = 0;
+	bool m_multiThreadRendering = false;
+	bool m_pipelinedFrames = false;
+	bool m_stealWork = false;		// set per frame, recording slots only steal when they run on several threads
 	Matrix m_viewRow = Matrix();
 	Matrix m_projRow = Matrix();
+	Matrix m_frameViewRow = Matrix();	// camera of the frame being recorded
+	Matrix m_frameProjRow = Matrix();
 	Vector3 m_camPos = Vector3(0.0f);
 	Vector3 m_camDir = Vector3(0.0f);
 
 	FontManager* m_fontManager = nullptr;
 	ResourceManager* m_resourceManager = nullptr;
 	TextureManager* m_textureManager = nullptr;
-	ConstantBufferManager* m_constantBufferManager[FRAME_PENDING_COUNT][MAX_THREAD_COUNT] = {};
+	ConstantBufferPool** m_constantBufferPool[FRAME_PENDING_COUNT] = {};
+	InstanceBufferPool** m_instanceBufferPool[FRAME_PENDING_COUNT] = {};
 	DescriptorAllocator* m_descriptorAllocator = nullptr;
-	DescriptorPool* m_descriptorPool[FRAME_PENDING_COUNT][MAX_THREAD_COUNT] = {};
-	CommandContext* m_cmdCtx[FRAME_PENDING_COUNT][MAX_THREAD_COUNT] = {};
-	RenderQueue* m_renderQueue[MAX_THREAD_COUNT] = {};
-	RENDER_THREAD_DESC* m_threadDesc = nullptr;
-	HANDLE m_completeThread = nullptr;
-	uint32 m_threadIdx = 0;
+	DescriptorRing* m_descriptorRing = nullptr;
+	PersistentConstantPool* m_persistentConstantPool = nullptr;
+	DescriptorPool** m_descriptorPool[FRAME_PENDING_COUNT] = {};
+	CommandContext** m_cmdCtx[FRAME_PENDING_COUNT] = {};
+	RenderQueue* m_renderQueues[RENDER_QUEUE_COUNT] = {};
+	RenderQueue* m_renderQueue = nullptr;		// filled by the Render calls
+	RenderQueue* m_recordQueue = nullptr;		// handed off by EndRender
+	uint32 m_renderQueueIdx = 0;
+	RenderCapture* m_renderCapture = nullptr;
+	RenderThreadPool* m_threadPool = nullptr;
+	RenderThreadPool* m_frameThread = nullptr;
+	TaskGraph* m_frameGraph = nullptr;
+	SORT_PASS_TASK_CONTEXT m_sortPassContexts[SORT_PASS_COUNT];
 	float m_dpi = 0.0f;
-	volatile uint64 m_activeThreadCount = 0;
 };
 
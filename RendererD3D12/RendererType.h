@@ -27,6 +27,20 @@ struct MESH_CONST_DATA
 	Matrix projection;
 };
 
+// Split layout of the VSMainFrameConst entries. Only the world matrix is written per draw at b0,
+// the camera once per frame at b1. All matrices are transposed like in MESH_CONST_DATA.
+struct OBJECT_CONST_DATA
+{
+	Matrix world;
+};
+
+struct FRAME_CONST_DATA
+{
+	Matrix view;
+	Matrix projection;
+	Matrix viewProjection;
+};
+
 struct SPRITE_CONST_DATA
 {
 	Vector2 screenResolution;
@@ -39,13 +53,6 @@ struct SPRITE_CONST_DATA
 	float alpha;
 };
 
-enum class CONSTANT_BUFFER_TYPE
-{
-	MESH_CONST_TYPE,
-	SPRITE_CONST_TYPE,
-	CONST_TYPE_COUNT,
-};
-
 /*
 ===================
 Command List
@@ -67,9 +74,17 @@ Texture
 
 struct TEXTURE_HANDLE
 {
+	static const uint32 UPLOAD_BUFFER_COUNT = 2;		// one per pending frame, see Renderer::FRAME_PENDING_COUNT
+
+	DL_LIST dirtyLink;
 	ID3D12Resource* textureResource = nullptr;
-	ID3D12Resource* uploadBuffer = nullptr;
+	ID3D12Resource* uploadBuffers[UPLOAD_BUFFER_COUNT] = {};
+	uint8* image = nullptr;		// contents written between uploads, laid out like an upload buffer. Dynamic textures only.
 	D3D12_CPU_DESCRIPTOR_HANDLE srv = {};
+	uint32 srvHandle = 0;		// DescriptorAllocator handle of srv
+	uint32 id = 0;
+	uint32 imageSize = 0;
+	bool isDirty = false;		// image holds contents not yet copied to textureResource
 	char name[32] = {};
 };
 
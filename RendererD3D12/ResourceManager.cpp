@@ -266,10 +266,9 @@ void ResourceManager::CreateTextureWidthImageData(ID3D12Resource** texResource,
     }
 }
 
-void ResourceManager::CreateTextureWidthUploadBuffer(ID3D12Resource** texResource, ID3D12Resource** uploadBuffer, uint32 texWidth, uint32 texHeight, DXGI_FORMAT format)
+void ResourceManager::CreateTextureWidthUploadBuffer(ID3D12Resource** texResource, ID3D12Resource** uploadBuffers, uint32 uploadBufferCount, uint32 texWidth, uint32 texHeight, DXGI_FORMAT format)
 {
     ID3D12Resource* textureResource = nullptr;
-    ID3D12Resource* upBuffer = nullptr;
 
     D3D12_RESOURCE_DESC textureDesc = {};
     textureDesc.MipLevels = 1;
@@ -286,10 +285,12 @@ void ResourceManager::CreateTextureWidthUploadBuffer(ID3D12Resource** texResourc
     
     uint64 uploadBufferSize = GetRequiredIntermediateSize(textureResource, 0, 1);
 
-    ThrowIfFailed(m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE, &CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&upBuffer)));
+    for (uint32 i = 0; i < uploadBufferCount; i++)
+    {
+        ThrowIfFailed(m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE, &CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&uploadBuffers[i])));
+    }
 
     *texResource = textureResource;
-    *uploadBuffer = upBuffer;
 }
 
 void ResourceManager::CreateCommandList()
@@ -22,7 +22,8 @@ public:
 	void CreateTiledImage(uint8* image, uint32 texWidth, uint32 texHeight, uint32 cellWidth, uint32 cellHeight);
 	void CreateTextureFromFile(ID3D12Resource** texResource, D3D12_RESOURCE_DESC* desc, const wchar_t* filename);
 	void CreateTextureWidthImageData(ID3D12Resource** texResource, uint8* imageData, D3D12_RESOURCE_DESC* desc, uint32 texWidth, uint32 texHeight, DXGI_FORMAT format);
-	void CreateTextureWidthUploadBuffer(ID3D12Resource** texResource, ID3D12Resource** uploadBuffer, uint32 texWidth, uint32 texHeight, DXGI_FORMAT format);
+	// Creates uploadBufferCount upload buffers, each sized for the whole texture.
+	void CreateTextureWidthUploadBuffer(ID3D12Resource** texResource, ID3D12Resource** uploadBuffers, uint32 uploadBufferCount, uint32 texWidth, uint32 texHeight, DXGI_FORMAT format);
 
 private:
 	void CreateCommandList();
@@ -0,0 +1,108 @@
+#include "pch.h"
+#include "SegmentedArray.h"
+
+/*
+==================
+SegmentedArray
+==================
+*/
+
+SegmentedArray::SegmentedArray()
+{
+}
+
+SegmentedArray::~SegmentedArray()
+{
+	CleanUp();
+}
+
+bool SegmentedArray::Initialize(uint32 elementSize, uint32 initialCount)
+{
+	m_elementSize = elementSize;
+
+	uint32 segmentCount = (initialCount + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+	for (uint32 i = 0; i < segmentCount; i++)
+	{
+		AllocSegment(i);
+	}
+
+	return true;
+}
+
+uint8* SegmentedArray::Reserve(uint32 idx)
+{
+	uint32 segmentIdx = idx >> SEGMENT_SHIFT;
+
+	uint8* segment = nullptr;
+	if (m_segmentTables[segmentIdx >> SEGMENT_TABLE_SHIFT])
+	{
+		segment = GetSegment(segmentIdx);
+	}
+	if (!segment)
+	{
+		segment = AllocSegment(segmentIdx);
+	}
+
+	return segment + m_elementSize * (idx & (SEGMENT_SIZE - 1));
+}
+
+void SegmentedArray::CleanUp()
+{
+	for (uint32 i = 0; i < MAX_SEGMENT_TABLE_COUNT; i++)
+	{
+		uint8* volatile* segmentTable = m_segmentTables[i];
+		if (!segmentTable)
+		{
+			continue;
+		}
+
+		for (uint32 j = 0; j < SEGMENT_TABLE_SIZE; j++)
+		{
+			if (segmentTable[j])
+			{
+				free(segmentTable[j]);
+			}
+		}
+		free((void*)segmentTable);
+		m_segmentTables[i] = nullptr;
+	}
+	m_segmentCount = 0;
+}
+
+uint8* SegmentedArray::AllocSegment(uint32 segmentIdx)
+{
+	uint8* volatile* segmentTable = m_segmentTables[segmentIdx >> SEGMENT_TABLE_SHIFT];
+	if (!segmentTable)
+	{
+		segmentTable = AllocSegmentTable(segmentIdx >> SEGMENT_TABLE_SHIFT);
+	}
+
+	uint8* segment = (uint8*)malloc(m_elementSize * SEGMENT_SIZE);
+
+	// Several producers may cross into the same new segment, only the first one publishes its allocation.
+	uint8* prevSegment = (uint8*)_InterlockedCompareExchangePointer((void* volatile*)&segmentTable[segmentIdx & (SEGMENT_TABLE_SIZE - 1)], segment, nullptr);
+	if (prevSegment)
+	{
+		free(segment);
+		return prevSegment;
+	}
+
+	_InterlockedIncrement(&m_segmentCount);
+
+	return segment;
+}
+
+uint8* volatile* SegmentedArray::AllocSegmentTable(uint32 tableIdx)
+{
+	uint8* volatile* segmentTable = (uint8* volatile*)calloc(SEGMENT_TABLE_SIZE, sizeof(uint8*));
+
+	// Published the same way as a segment.
+	uint8* volatile* prevTable = (uint8* volatile*)_InterlockedCompareExchangePointer((void* volatile*)&m_segmentTables[tableIdx], (void*)segmentTable, nullptr);
+	if (prevTable)
+	{
+		free((void*)segmentTable);
+		return prevTable;
+	}
+
+	return segmentTable;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+==================
+SegmentedArray
+==================
+*/
+
+// Array of fixed size elements stored in equally sized segments.
+// Segments are allocated on first use and kept for the following frames, so elements never move.
+// Segment pointers live in tables of SEGMENT_TABLE_SIZE, allocated on first use as well, so any uint32 index fits.
+class SegmentedArray
+{
+public:
+	static const uint32 SEGMENT_SHIFT = 12;
+	static const uint32 SEGMENT_SIZE = 1 << SEGMENT_SHIFT;
+	static const uint32 SEGMENT_TABLE_SHIFT = 10;
+	static const uint32 SEGMENT_TABLE_SIZE = 1 << SEGMENT_TABLE_SHIFT;
+	static const uint32 MAX_SEGMENT_TABLE_COUNT = 1 << (32 - SEGMENT_SHIFT - SEGMENT_TABLE_SHIFT);
+
+	SegmentedArray();
+	~SegmentedArray();
+
+	bool Initialize(uint32 elementSize, uint32 initialCount);
+	// Safe to call from any number of threads at once.
+	uint8* Reserve(uint32 idx);
+
+	inline uint8* Get(uint32 idx) { return GetSegment(idx >> SEGMENT_SHIFT) + m_elementSize * (idx & (SEGMENT_SIZE - 1)); }
+	inline uint8* GetSegment(uint32 segmentIdx) { return m_segmentTables[segmentIdx >> SEGMENT_TABLE_SHIFT][segmentIdx & (SEGMENT_TABLE_SIZE - 1)]; }
+	inline uint32 GetSegmentCount() { return static_cast<uint32>(m_segmentCount); }
+	inline uint32 GetCapacity() { return GetSegmentCount() * SEGMENT_SIZE; }
+
+private:
+	void CleanUp();
+	uint8* AllocSegment(uint32 segmentIdx);
+	uint8* volatile* AllocSegmentTable(uint32 tableIdx);
+
+private:
+	uint8* volatile* volatile m_segmentTables[MAX_SEGMENT_TABLE_COUNT] = {};
+	uint32 m_elementSize = 0;
+	volatile long m_segmentCount = 0;
+};
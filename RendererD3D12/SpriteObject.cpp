@@ -2,9 +2,13 @@
 #include "SpriteObject.h"
 #include "Renderer.h"
 #include "ResourceManager.h"
-#include "ConstantBufferManager.h"
 #include "ConstantBufferPool.h"
+#include "ConstantWriter.h"
+#include "DescriptorAllocator.h"
 #include "DescriptorPool.h"
+#include "InstanceBufferPool.h"
+#include "RenderQueue.h"
+#include "CommandListState.h"
 
 /*
 =================
@@ -12,6 +16,7 @@ SpriteObject
 =================
 */
 
+uint32 SpriteObject::sm_lastSpriteId;
 uint32 SpriteObject::sm_initRefCount;
 ID3D12RootSignature* SpriteObject::sm_rootSignature;
 ID3D12PipelineState* SpriteObject::sm_pipelineState;
@@ -19,6 +24,10 @@ D3D12_VERTEX_BUFFER_VIEW SpriteObject::sm_vbView;
 D3D12_INDEX_BUFFER_VIEW SpriteObject::sm_ibView;
 ID3D12Resource* SpriteObject::sm_vertexBuffer;
 ID3D12Resource* SpriteObject::sm_indexBuffer;
+ID3D12PipelineState* SpriteObject::sm_batchPipelineState;
+D3D12_INDEX_BUFFER_VIEW SpriteObject::sm_batchIbView;
+ID3D12Resource* SpriteObject::sm_batchIndexBuffer;
+bool SpriteObject::sm_bindlessTextures;
 
 SpriteObject::SpriteObject()
 {
@@ -32,6 +41,7 @@ SpriteObject::~SpriteObject()
 bool SpriteObject::Initialize(Renderer* renderer)
 {
 	m_renderer = renderer;
+	m_spriteId = ++sm_lastSpriteId;
 
 	bool result = true;
 	if (sm_initRefCount == 0)
@@ -47,6 +57,7 @@ bool SpriteObject::Initialize(Renderer* renderer)
 bool SpriteObject::Initialize(Renderer* renderer, const wchar_t* filename, const RECT* rect)
 {
 	m_renderer = renderer;
+	m_spriteId = ++sm_lastSpriteId;
 
 	bool result = true;
 	if (sm_initRefCount == 0)
@@ -85,29 +96,24 @@ bool SpriteObject::Initialize(Renderer* renderer, const wchar_t* filename, const
 	return true;
 }
 
-void SpriteObject::Draw(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, float posX, float posY, float scaleX, float scaleY, float z)
+void SpriteObject::Draw(CommandListState* cmdState, uint32 threadIdx, float posX, float posY, float scaleX, float scaleY, float z)
 {
 	Vector2 scale = Vector2(m_scale.x * scaleX, m_scale.y * scaleY);
-	DrawWithTexture(cmdList, threadIdx, posX, posY, scale.x, scale.y, z, &m_rect, m_textureHandle);
+	DrawWithTexture(cmdState, threadIdx, posX, posY, scale.x, scale.y, z, &m_rect, m_textureHandle);
 }
 
-void SpriteObject::DrawWithTexture(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, float posX, float posY, float scaleX, float scaleY, float z, const RECT* rect, TEXTURE_HANDLE* textureHandle)
+void SpriteObject::DrawWithTexture(CommandListState* cmdState, uint32 threadIdx, float posX, float posY, float scaleX, float scaleY, float z, const RECT* rect, TEXTURE_HANDLE* textureHandle)
 {
-	ID3D12Device5* device = m_renderer->GetDevice();
-	ConstantBufferManager* cbManager = m_renderer->GetConstantBufferManager(threadIdx);
-	ConstantBufferPool* cbPool = cbManager->GetConstantBufferPool(CONSTANT_BUFFER_TYPE::SPRITE_CONST_TYPE);
-	DescriptorPool* descPool = m_renderer->GetDescriptorPool(threadIdx);
-	ID3D12DescriptorHeap* descHeap = descPool->GetDesciptorHeap();
+	ID3D12GraphicsCommandList* cmdList = cmdState->GetCommandList();
+	ConstantBufferPool* cbPool = m_renderer->GetConstantBufferPool(threadIdx);
 
 	uint32 texWidth = 0;
 	uint32 texHeight = 0;
-	D3D12_CPU_DESCRIPTOR_HANDLE srv = {};
 	if (textureHandle)
 	{
 		D3D12_RESOURCE_DESC desc = textureHandle->textureResource->GetDesc();
 		texWidth = static_cast<uint32>(desc.Width);
 		texHeight = static_cast<uint32>(desc.Height);
-		srv = textureHandle->srv;
 	}
 
 	RECT rt = {};
@@ -120,49 +126,181 @@ void SpriteObject::DrawWithTexture(ID3D12GraphicsCommandList* cmdList, uint32 th
 		rect = &rt;
 	}
 
-	ConstantBuffer* constantBuffer = cbPool->Alloc();
+	D3D12_GPU_VIRTUAL_ADDRESS cbAddr = 0;
+	uint8* cbPtr = cbPool->Alloc(sizeof(SPRITE_CONST_DATA), &cbAddr);
 	SPRITE_CONST_DATA constData = {};
 
-	if (constantBuffer)
+	if (!cbPtr)
 	{
-		constData.screenResolution.x = static_cast<float>(m_renderer->GetScreenWidth());
-		constData.screenResolution.y = static_cast<float>(m_renderer->GetScreenHegiht());
-		constData.posOffset.x = posX;
-		constData.posOffset.y = posY;
-		constData.scale.x = scaleX;
-		constData.scale.y = scaleY;
-		constData.texSize.x = static_cast<float>(texWidth);
-		constData.texSize.y = static_cast<float>(texHeight);
-		constData.texOffset.x = static_cast<float>(rect->left);
-		constData.texOffset.y = static_cast<float>(rect->top);
-		constData.texScale.x = static_cast<float>(rect->right - rect->left);
-		constData.texScale.y = static_cast<float>(rect->bottom - rect->top);
-		constData.depthZ = z;
-		constData.alpha = 1.0f;
+		__debugbreak();
+	}
+
+	constData.screenResolution.x = static_cast<float>(m_renderer->GetScreenWidth());
+	constData.screenResolution.y = static_cast<float>(m_renderer->GetScreenHegiht());
+	constData.posOffset.x = posX;
+	constData.posOffset.y = posY;
+	constData.scale.x = scaleX;
+	constData.scale.y = scaleY;
+	constData.texSize.x = static_cast<float>(texWidth);
+	constData.texSize.y = static_cast<float>(texHeight);
+	constData.texOffset.x = static_cast<float>(rect->left);
+	constData.texOffset.y = static_cast<float>(rect->top);
+	constData.texScale.x = static_cast<float>(rect->right - rect->left);
+	constData.texScale.y = static_cast<float>(rect->bottom - rect->top);
+	constData.depthZ = z;
+	constData.alpha = 1.0f;
+
+	ConstantWriter::Write(cbPtr, &constData, sizeof(SPRITE_CONST_DATA));
+
+	cmdState->SetRootSignature(sm_rootSignature);
+	cmdState->SetPipelineState(sm_pipelineState);
+
+	cmdList->SetGraphicsRootConstantBufferView(0, cbAddr);
+	BindTexture(cmdState, m_renderer, threadIdx, textureHandle);
+	cmdState->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cmdState->SetVertexBuffer(&sm_vbView);
+	cmdState->SetIndexBuffer(&sm_ibView);
+	cmdList->DrawIndexedInstanced(6, 1, 0, 0, 0);
+}
 
-		memcpy(constantBuffer->sysMemAddr, &constData, sizeof(SPRITE_CONST_DATA));
+bool SpriteObject::DrawBatch(CommandListState* cmdState, uint32 threadIdx, SpriteObject* const* spriteObjs, const SPRITE_RENDER_JOB* const* spriteJobs, uint32 spriteCount, TEXTURE_HANDLE* textureHandle)
+{
+	if (spriteCount > MAX_SPRITE_COUNT_PER_BATCH)
+	{
+		__debugbreak();
 	}
 
-	CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle = {};
-	CD3DX12_GPU_DESCRIPTOR_HANDLE gpuHandle = {};
-	descPool->Alloc(&cpuHandle, &gpuHandle, MAX_DESCRIPTOR_COUNT_FOR_DRAW);
-	
-	cmdList->SetGraphicsRootSignature(sm_rootSignature);
-	cmdList->SetPipelineState(sm_pipelineState);
-	cmdList->SetDescriptorHeaps(1, &descHeap);
+	Renderer* renderer = spriteObjs[0]->m_renderer;
+	ID3D12GraphicsCommandList* cmdList = cmdState->GetCommandList();
+	ConstantBufferPool* cbPool = renderer->GetConstantBufferPool(threadIdx);
+	InstanceBufferPool* vertexPool = renderer->GetInstanceBufferPool(threadIdx);
 
-	device->CopyDescriptorsSimple(1, cpuHandle, constantBuffer->cbvCpuHandle, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-	cpuHandle.Offset(1, descPool->GetTypeSize());
-	if (srv.ptr)
+	D3D12_VERTEX_BUFFER_VIEW vbView = {};
+	SpriteVertex* vertices = reinterpret_cast<SpriteVertex*>(vertexPool->Alloc(spriteCount * 4, sizeof(SpriteVertex), &vbView));
+	if (!vertices)
 	{
-		device->CopyDescriptorsSimple(1, cpuHandle, srv, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		return false;
 	}
 
-	cmdList->SetGraphicsRootDescriptorTable(0, gpuHandle);
-	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	cmdList->IASetVertexBuffers(0, 1, &sm_vbView);
-	cmdList->IASetIndexBuffer(&sm_ibView);
-	cmdList->DrawIndexedInstanced(6, 1, 0, 0, 0);
+	uint32 texWidth = 0;
+	uint32 texHeight = 0;
+	if (textureHandle)
+	{
+		D3D12_RESOURCE_DESC desc = textureHandle->textureResource->GetDesc();
+		texWidth = static_cast<uint32>(desc.Width);
+		texHeight = static_cast<uint32>(desc.Height);
+	}
+
+	float screenWidth = static_cast<float>(renderer->GetScreenWidth());
+	float screenHeight = static_cast<float>(renderer->GetScreenHegiht());
+
+	// Same math as VSMain in SpriteShader.hlsl, done once per vertex on the CPU so VSBatched only passes it through.
+	static const float corners[4][2] = { {0.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, 0.0f} };
+	for (uint32 i = 0; i < spriteCount; i++)
+	{
+		const SPRITE_RENDER_JOB* spriteJob = spriteJobs[i];
+		SpriteObject* spriteObj = spriteObjs[i];
+
+		float scaleX = spriteJob->scaleX;
+		float scaleY = spriteJob->scaleY;
+		const RECT* rect = spriteJob->hasRect ? &spriteJob->rect : nullptr;
+		if (!spriteJob->texHandle)
+		{
+			// Sprites drawn without a texture argument use the object's own texture, rect and scale.
+			scaleX *= spriteObj->m_scale.x;
+			scaleY *= spriteObj->m_scale.y;
+			rect = &spriteObj->m_rect;
+		}
+
+		RECT rt = {};
+		if (!rect)
+		{
+			rt.right = texWidth;
+			rt.bottom = texHeight;
+			rect = &rt;
+		}
+
+		float quadScaleX = texWidth / screenWidth * scaleX;
+		float quadScaleY = texHeight / screenHeight * scaleY;
+		float quadOffsetX = spriteJob->posX / screenWidth;
+		float quadOffsetY = spriteJob->posY / screenHeight;
+		float uvScaleX = texWidth ? static_cast<float>(rect->right - rect->left) / texWidth : 0.0f;
+		float uvScaleY = texHeight ? static_cast<float>(rect->bottom - rect->top) / texHeight : 0.0f;
+		float uvOffsetX = texWidth ? static_cast<float>(rect->left) / texWidth : 0.0f;
+		float uvOffsetY = texHeight ? static_cast<float>(rect->top) / texHeight : 0.0f;
+
+		for (uint32 j = 0; j < 4; j++)
+		{
+			float posX = (corners[j][0] * quadScaleX + quadOffsetX) * 2.0f - 1.0f;
+			float posY = (corners[j][1] * quadScaleY + quadOffsetY) * -2.0f + 1.0f;
+			float u = corners[j][0] * uvScaleX + uvOffsetX;
+			float v = corners[j][1] * uvScaleY + uvOffsetY;
+
+			SpriteVertex vertex = { {posX, posY, spriteJob->z}, {1.0f, 1.0f, 1.0f}, {u, v} };
+			vertices[i * 4 + j] = vertex;
+		}
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS cbAddr = 0;
+	uint8* cbPtr = cbPool->Alloc(sizeof(SPRITE_CONST_DATA), &cbAddr);
+	if (!cbPtr)
+	{
+		__debugbreak();
+	}
+
+	SPRITE_CONST_DATA constData = {};
+	constData.screenResolution.x = screenWidth;
+	constData.screenResolution.y = screenHeight;
+	constData.texSize.x = static_cast<float>(texWidth);
+	constData.texSize.y = static_cast<float>(texHeight);
+	constData.alpha = 1.0f;
+	ConstantWriter::Write(cbPtr, &constData, sizeof(SPRITE_CONST_DATA));
+
+	cmdState->SetRootSignature(sm_rootSignature);
+	cmdState->SetPipelineState(sm_batchPipelineState);
+
+	cmdList->SetGraphicsRootConstantBufferView(0, cbAddr);
+	BindTexture(cmdState, renderer, threadIdx, textureHandle);
+	cmdState->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cmdState->SetVertexBuffer(&vbView);
+	cmdState->SetIndexBuffer(&sm_batchIbView);
+	cmdList->DrawIndexedInstanced(spriteCount * 6, 1, 0, 0, 0);
+
+	return true;
+}
+
+void SpriteObject::BindTexture(CommandListState* cmdState, Renderer* renderer, uint32 threadIdx, TEXTURE_HANDLE* textureHandle)
+{
+	ID3D12GraphicsCommandList* cmdList = cmdState->GetCommandList();
+
+	if (sm_bindlessTextures)
+	{
+		DescriptorAllocator* descriptorAllocator = renderer->GetDescriptorAllocator();
+		uint32 textureIdx = textureHandle ? descriptorAllocator->GetShaderIndex(textureHandle->srvHandle) : descriptorAllocator->GetNullSrvIndex();
+
+		cmdState->SetDescriptorHeap(descriptorAllocator->GetShaderVisibleHeap());
+		cmdList->SetGraphicsRootDescriptorTable(3, descriptorAllocator->GetShaderVisibleHeapStart());
+		cmdList->SetGraphicsRoot32BitConstant(2, textureIdx, 0);
+		return;
+	}
+
+	DescriptorPool* descPool = renderer->GetDescriptorPool(threadIdx);
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE gpuHandle = {};
+	if (textureHandle)
+	{
+		// Sprites of one texture, static UI being the usual case, all bind the table of the first.
+		descPool->AllocTable(&gpuHandle, &textureHandle->srv, MAX_DESCRIPTOR_COUNT_FOR_DRAW);
+	}
+	else
+	{
+		CD3DX12_CPU_DESCRIPTOR_HANDLE cpuHandle = {};
+		descPool->Alloc(&cpuHandle, &gpuHandle, MAX_DESCRIPTOR_COUNT_FOR_DRAW);
+	}
+
+	cmdState->SetDescriptorHeap(descPool->GetDesciptorHeap());
+
+	cmdList->SetGraphicsRootDescriptorTable(1, gpuHandle);
 }
 
 HRESULT __stdcall SpriteObject::QueryInterface(REFIID riid, void** ppvObject)
@@ -219,12 +357,17 @@ void SpriteObject::CreateRootSignature()
 	ID3DBlob* signature = nullptr;
 	ID3DBlob* error = nullptr;
 
-	CD3DX12_DESCRIPTOR_RANGE rangesPerObj[2] = {};
-	rangesPerObj[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0); // b0 
-	rangesPerObj[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0); // t0
+	CD3DX12_DESCRIPTOR_RANGE rangesPerObj[1] = {};
+	rangesPerObj[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0); // t0
+
+	CD3DX12_DESCRIPTOR_RANGE bindlessRanges[1] = {};
+	bindlessRanges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, Renderer::MAX_DESCRIPTOR_COUNT, 0, 1); // t0, space1
 
-	CD3DX12_ROOT_PARAMETER rootParameters[1] = {};
-	rootParameters[0].InitAsDescriptorTable(_countof(rangesPerObj), rangesPerObj, D3D12_SHADER_VISIBILITY_ALL);
+	CD3DX12_ROOT_PARAMETER rootParameters[4] = {};
+	rootParameters[0].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_ALL); // b0
+	rootParameters[1].InitAsDescriptorTable(_countof(rangesPerObj), rangesPerObj, D3D12_SHADER_VISIBILITY_ALL);
+	rootParameters[2].InitAsConstants(1, 2, 0, D3D12_SHADER_VISIBILITY_PIXEL); // b2, texture index
+	rootParameters[3].InitAsDescriptorTable(_countof(bindlessRanges), bindlessRanges, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	D3D12_STATIC_SAMPLER_DESC samplterDesc = {};
 	//pOutSamperDesc->Filter = D3D12_FILTER_ANISOTROPIC;
@@ -301,6 +444,15 @@ void SpriteObject::CreatePipelineState()
 		__debugbreak();
 	}
 
+	// Optional. Same contract as PSMainBindless in BasicShader.hlsl, SRV array at t0, space1 and the index at b2.
+	ID3DBlob* bindlessPixelShader = nullptr;
+	if (D3DUtils::CompileOptionalShader(L"../../Shader/SpriteShader.hlsl", "PSMainBindless", "ps_5_1", compileFlags, &bindlessPixelShader))
+	{
+		pixelShader->Release();
+		pixelShader = bindlessPixelShader;
+		sm_bindlessTextures = true;
+	}
+
 	// Define the vertex input layout.
 	D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
 	{
@@ -335,6 +487,16 @@ void SpriteObject::CreatePipelineState()
 		vertexShader->Release();
 		vertexShader = nullptr;
 	}
+
+	// The batch pipeline is optional. Without the VSBatched entry every sprite job is drawn on its own.
+	if (D3DUtils::CompileOptionalShader(L"../../Shader/SpriteShader.hlsl", "VSBatched", "vs_5_0", compileFlags, &vertexShader))
+	{
+		psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader->GetBufferPointer(), vertexShader->GetBufferSize());
+		ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&sm_batchPipelineState)));
+
+		vertexShader->Release();
+		vertexShader = nullptr;
+	}
 	if (pixelShader)
 	{
 		pixelShader->Release();
@@ -376,6 +538,25 @@ void SpriteObject::CreateBuffers()
 	sm_ibView = ibView;
 	sm_vertexBuffer = vertexBuffer;
 	sm_indexBuffer = indexBuffer;
+
+	// Quads of a batch are written 4 vertices apart, so one shared index buffer covers every batch.
+	uint32 numBatchIndices = MAX_SPRITE_COUNT_PER_BATCH * numIndices;
+	uint32* batchIndices = new uint32[numBatchIndices];
+	for (uint32 i = 0; i < MAX_SPRITE_COUNT_PER_BATCH; i++)
+	{
+		for (uint32 j = 0; j < numIndices; j++)
+		{
+			batchIndices[i * numIndices + j] = i * numVertices + indices[j];
+		}
+	}
+
+	resourceManager->CreateIndexBuffer(sizeof(uint32), numBatchIndices, batchIndices, &ibView, &indexBuffer);
+
+	sm_batchIbView = ibView;
+	sm_batchIndexBuffer = indexBuffer;
+
+	delete[] batchIndices;
+	batchIndices = nullptr;
 }
 
 void SpriteObject::DestroyRootSignature()
@@ -389,6 +570,13 @@ void SpriteObject::DestroyRootSignature()
 
 void SpriteObject::DestroyPipelineState()
 {
+	sm_bindlessTextures = false;
+
+	if (sm_batchPipelineState)
+	{
+		sm_batchPipelineState->Release();
+		sm_batchPipelineState = nullptr;
+	}
 	if (sm_pipelineState)
 	{
 		sm_pipelineState->Release();
@@ -398,6 +586,11 @@ void SpriteObject::DestroyPipelineState()
 
 void SpriteObject::DestroyBuffers()
 {
+	if (sm_batchIndexBuffer)
+	{
+		sm_batchIndexBuffer->Release();
+		sm_batchIndexBuffer = nullptr;
+	}
 	if (sm_indexBuffer)
 	{
 		sm_indexBuffer->Release();
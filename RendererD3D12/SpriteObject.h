@@ -9,11 +9,19 @@ SpriteObject
 */
 
 class Renderer;
+class CommandListState;
+struct SPRITE_RENDER_JOB;
 
 class SpriteObject : public IT_SpriteObject
 {
 public:
-	static const uint32 MAX_DESCRIPTOR_COUNT_FOR_DRAW = 2;
+	static const uint32 MAX_DESCRIPTOR_COUNT_FOR_DRAW = 1;		// SRV(t0), CB(b0) is a root CBV
+	static const uint32 MAX_SPRITE_COUNT_PER_BATCH = 1024;
+
+	static inline bool IsBatchingSupported() { return sm_batchPipelineState != nullptr; }
+	static inline bool IsBindlessTexturesSupported() { return sm_bindlessTextures; }
+	// Draws sprites sharing textureHandle as one indexed draw. Returns false when the frame's vertex budget is used up.
+	static bool DrawBatch(CommandListState* cmdState, uint32 threadIdx, SpriteObject* const* spriteObjs, const SPRITE_RENDER_JOB* const* spriteJobs, uint32 spriteCount, TEXTURE_HANDLE* textureHandle);
 
 	SpriteObject();
 	~SpriteObject();
@@ -21,8 +29,11 @@ public:
 	/*DLL Inner*/
 	bool Initialize(Renderer* renderer);
 	bool Initialize(Renderer* renderer, const wchar_t* filename, const RECT* rect);
-	void Draw(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, float posX, float posY, float scaleX, float scaleY, float z);
-	void DrawWithTexture(ID3D12GraphicsCommandList* cmdList, uint32 threadIdx, float posX, float posY, float scaleX, float scaleY, float z, const RECT* rect, TEXTURE_HANDLE* textureHandle);
+	void Draw(CommandListState* cmdState, uint32 threadIdx, float posX, float posY, float scaleX, float scaleY, float z);
+	void DrawWithTexture(CommandListState* cmdState, uint32 threadIdx, float posX, float posY, float scaleX, float scaleY, float z, const RECT* rect, TEXTURE_HANDLE* textureHandle);
+	inline uint32 GetSpriteId() { return m_spriteId; }
+	inline uint32 GetTextureId() { return m_textureHandle ? m_textureHandle->id : 0; }
+	inline TEXTURE_HANDLE* GetTextureHandle() { return m_textureHandle; }
 
 	/*Interface*/
 	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, _COM_Outptr_ void __RPC_FAR* __RPC_FAR* ppvObject);
@@ -30,6 +41,9 @@ public:
 	virtual ULONG STDMETHODCALLTYPE Release(void);
 
 private:
+	// Call after the root signature is set. A null textureHandle binds nothing, or the null SRV when bindless.
+	static void BindTexture(CommandListState* cmdState, Renderer* renderer, uint32 threadIdx, TEXTURE_HANDLE* textureHandle);
+
 	void CleanUp();
 	bool InitPipeline();
 	void CleanUpPipeline();
@@ -41,6 +55,7 @@ private:
 	void DestroyBuffers();
 
 private:
+	static uint32 sm_lastSpriteId;
 	static uint32 sm_initRefCount;
 	static ID3D12RootSignature* sm_rootSignature;
 	static ID3D12PipelineState* sm_pipelineState;
@@ -48,8 +63,13 @@ private:
 	static D3D12_INDEX_BUFFER_VIEW sm_ibView;
 	static ID3D12Resource* sm_vertexBuffer;
 	static ID3D12Resource* sm_indexBuffer;
+	static ID3D12PipelineState* sm_batchPipelineState;
+	static D3D12_INDEX_BUFFER_VIEW sm_batchIbView;
+	static ID3D12Resource* sm_batchIndexBuffer;
+	static bool sm_bindlessTextures;
 	Renderer* m_renderer = nullptr;
 	uint32 m_refCount = 1;
+	uint32 m_spriteId = 0;
 	TEXTURE_HANDLE* m_textureHandle = nullptr;
 	RECT m_rect = {};
 	Vector2 m_scale = Vector2(1.0f);
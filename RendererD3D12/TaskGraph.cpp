@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "TaskGraph.h"
+
+/*
+=================
+TaskGraph
+=================
+*/
+
+TaskGraph::TaskGraph()
+{
+}
+
+TaskGraph::~TaskGraph()
+{
+}
+
+void TaskGraph::Reset()
+{
+	m_taskCount = 0;
+	m_doneTaskCount.store(0, std::memory_order_relaxed);
+}
+
+uint32 TaskGraph::AddTask(TASK_FUNC func, void* context, uint32 itemCount)
+{
+	if (m_taskCount >= MAX_TASK_COUNT)
+	{
+		__debugbreak();
+	}
+
+	uint32 taskIdx = m_taskCount;
+	TASK* task = m_tasks + taskIdx;
+	task->func = func;
+	task->context = context;
+	task->itemCount = itemCount;
+	task->claimCount = itemCount ? itemCount : 1;
+	task->dependentCount = 0;
+	task->nextItem.store(0, std::memory_order_relaxed);
+	task->doneItemCount.store(0, std::memory_order_relaxed);
+	task->pendingDependencyCount.store(0, std::memory_order_relaxed);
+
+	m_taskCount++;
+
+	return taskIdx;
+}
+
+void TaskGraph::AddDependency(uint32 taskIdx, uint32 dependencyTaskIdx)
+{
+	TASK* dependency = m_tasks + dependencyTaskIdx;
+	if (taskIdx >= m_taskCount || dependencyTaskIdx >= taskIdx || dependency->dependentCount >= TASK::MAX_DEPENDENT_COUNT)
+	{
+		__debugbreak();
+	}
+
+	dependency->dependents[dependency->dependentCount] = taskIdx;
+	dependency->dependentCount++;
+	m_tasks[taskIdx].pendingDependencyCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TaskGraph::Run()
+{
+	while (m_doneTaskCount.load(std::memory_order_acquire) < m_taskCount)
+	{
+		if (!RunItem())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool TaskGraph::RunItem()
+{
+	for (uint32 i = 0; i < m_taskCount; i++)
+	{
+		TASK* task = m_tasks + i;
+		if (task->pendingDependencyCount.load(std::memory_order_acquire) != 0)
+		{
+			continue;
+		}
+		if (task->nextItem.load(std::memory_order_relaxed) >= task->claimCount)
+		{
+			continue;
+		}
+
+		uint32 itemIdx = task->nextItem.fetch_add(1, std::memory_order_acq_rel);
+		if (itemIdx >= task->claimCount)
+		{
+			continue;
+		}
+
+		if (itemIdx < task->itemCount)
+		{
+			task->func(task->context, itemIdx);
+		}
+
+		if (task->doneItemCount.fetch_add(1, std::memory_order_acq_rel) + 1 == task->claimCount)
+		{
+			CompleteTask(task);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+void TaskGraph::CompleteTask(TASK* task)
+{
+	for (uint32 i = 0; i < task->dependentCount; i++)
+	{
+		m_tasks[task->dependents[i]].pendingDependencyCount.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	m_doneTaskCount.fetch_add(1, std::memory_order_acq_rel);
+}
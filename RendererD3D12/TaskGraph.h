@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+=================
+TaskGraph
+=================
+*/
+
+typedef void (*TASK_FUNC)(void* context, uint32 itemIdx);
+
+struct TASK
+{
+	static const uint32 MAX_DEPENDENT_COUNT = 8;
+
+	TASK_FUNC func = nullptr;
+	void* context = nullptr;
+	uint32 itemCount = 0;
+	uint32 claimCount = 0;		// itemCount, but at least one so empty tasks still complete
+	uint32 dependentCount = 0;
+	uint32 dependents[MAX_DEPENDENT_COUNT] = {};
+	std::atomic<uint32> nextItem = { 0 };
+	std::atomic<uint32> doneItemCount = { 0 };
+	std::atomic<uint32> pendingDependencyCount = { 0 };
+};
+
+// A task becomes ready once every task it depends on is done. A task with more than one item is a parallel for,
+// its items go to whichever worker is free, and a task depending on several others is a fan in.
+// Build the graph on one thread, then call Run from every worker taking part.
+class TaskGraph
+{
+public:
+	static const uint32 MAX_TASK_COUNT = 32;
+
+	TaskGraph();
+	~TaskGraph();
+
+	void Reset();
+	uint32 AddTask(TASK_FUNC func, void* context, uint32 itemCount);
+	// taskIdx does not start before dependencyTaskIdx is done.
+	void AddDependency(uint32 taskIdx, uint32 dependencyTaskIdx);
+	// Runs items until every task is done. Any number of workers may call it at once.
+	void Run();
+
+	inline uint32 GetTaskCount() { return m_taskCount; }
+
+private:
+	bool RunItem();
+	void CompleteTask(TASK* task);
+
+private:
+	TASK m_tasks[MAX_TASK_COUNT];
+	uint32 m_taskCount = 0;
+	std::atomic<uint32> m_doneTaskCount = { 0 };
+};
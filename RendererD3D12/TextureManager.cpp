@@ -4,6 +4,8 @@
 #include "Renderer.h"
 #include "DescriptorAllocator.h"
 
+static_assert(TEXTURE_HANDLE::UPLOAD_BUFFER_COUNT == Renderer::FRAME_PENDING_COUNT, "one upload buffer per pending frame");
+
 /*
 =================
 TextureManager
@@ -30,13 +32,13 @@ bool TextureManager::Initialize(Renderer* renderer)
 
 TEXTURE_HANDLE* TextureManager::CreateTiledTexture(uint32 texWidth, uint32 texHeight, uint32 cellWidth, uint32 cellHeight)
 {
-	ID3D12Device5* device = m_renderer->GetDevice();
 	ID3D12Resource* texResource = nullptr;
 	ResourceManager* resourceManager = m_renderer->GetReourceManager();
 	DescriptorAllocator* descriptorAllocator = m_renderer->GetDescriptorAllocator();
 	D3D12_RESOURCE_DESC texDesc = {};
 	TEXTURE_HANDLE* textureHandle = nullptr;
 	D3D12_CPU_DESCRIPTOR_HANDLE srv = {};
+	uint32 srvHandle = 0;
 
 	uint8* image = (uint8*)malloc(texWidth * texHeight * 4);
 	resourceManager->CreateTiledImage(image, texWidth, texHeight, cellWidth, cellHeight);
@@ -50,15 +52,17 @@ TEXTURE_HANDLE* TextureManager::CreateTiledTexture(uint32 texWidth, uint32 texHe
 		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 		srvDesc.Texture2D.MipLevels = texDesc.MipLevels;
 
-		descriptorAllocator->AllocateDescriptorHeap(&srv);
+		srvHandle = descriptorAllocator->Alloc(&srv);
 		if (srv.ptr)
 		{
-			device->CreateShaderResourceView(texResource, &srvDesc, srv);
+			descriptorAllocator->CreateShaderResourceView(srvHandle, texResource, &srvDesc);
 
 			textureHandle = new TEXTURE_HANDLE;
 			::memset(textureHandle, 0, sizeof(TEXTURE_HANDLE));
 			textureHandle->textureResource = texResource;
 			textureHandle->srv = srv;
+			textureHandle->srvHandle = srvHandle;
+			textureHandle->id = ++m_lastTextureId;
 		}
 		else
 		{
@@ -75,13 +79,13 @@ TEXTURE_HANDLE* TextureManager::CreateTiledTexture(uint32 texWidth, uint32 texHe
 
 TEXTURE_HANDLE* TextureManager::CreateTextureFromFile(const wchar_t* filename)
 {
-	ID3D12Device5* device = m_renderer->GetDevice();
 	ResourceManager* resourceManager = m_renderer->GetReourceManager();
 	DescriptorAllocator* descriptorAllocator = m_renderer->GetDescriptorAllocator();
 	TEXTURE_HANDLE* textureHandle = nullptr;
 	ID3D12Resource* texResource = nullptr;
 	D3D12_RESOURCE_DESC resDesc = {};
 	D3D12_CPU_DESCRIPTOR_HANDLE srv = {};
+	uint32 srvHandle = 0;
 
 	void* findValue = HT_Find(m_hashTable, (void*)filename);
 	if (findValue)
@@ -99,15 +103,17 @@ TEXTURE_HANDLE* TextureManager::CreateTextureFromFile(const wchar_t* filename)
 			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 			srvDesc.Texture2D.MipLevels = resDesc.MipLevels;
 
-			descriptorAllocator->AllocateDescriptorHeap(&srv);
+			srvHandle = descriptorAllocator->Alloc(&srv);
 			if (srv.ptr)
 			{
-				device->CreateShaderResourceView(texResource, &srvDesc, srv);
+				descriptorAllocator->CreateShaderResourceView(srvHandle, texResource, &srvDesc);
 
 				textureHandle = new TEXTURE_HANDLE;
 				::memset(textureHandle, 0, sizeof(TEXTURE_HANDLE));
 				textureHandle->textureResource = texResource;
 				textureHandle->srv = srv;
+				textureHandle->srvHandle = srvHandle;
+				textureHandle->id = ++m_lastTextureId;
 
 				HT_Insert(m_hashTable, (void*)filename, (void*)textureHandle);
 			}
@@ -124,17 +130,18 @@ TEXTURE_HANDLE* TextureManager::CreateTextureFromFile(const wchar_t* filename)
 
 TEXTURE_HANDLE* TextureManager::CreateDynamicTexture(uint32 texWidth, uint32 texHeight, const char* name)
 {
-	ID3D12Device5* device = m_renderer->GetDevice();
 	ResourceManager* resourceManager = m_renderer->GetReourceManager();
 	DescriptorAllocator* descriptorAllocator = m_renderer->GetDescriptorAllocator();
 	TEXTURE_HANDLE* textureHandle = nullptr;
 	ID3D12Resource* texResource = nullptr;
-	ID3D12Resource* uploadBuffer = nullptr;
+	ID3D12Resource* uploadBuffers[TEXTURE_HANDLE::UPLOAD_BUFFER_COUNT] = {};
 	D3D12_CPU_DESCRIPTOR_HANDLE srv = {};
+	uint32 srvHandle = 0;
 	DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
 
-	resourceManager->CreateTextureWidthUploadBuffer(&texResource, &uploadBuffer, texWidth, texHeight, format);
-	if (texResource && uploadBuffer)
+	// The game thread writes the next contents while the GPU may still copy from the last frame's upload buffer.
+	resourceManager->CreateTextureWidthUploadBuffer(&texResource, uploadBuffers, TEXTURE_HANDLE::UPLOAD_BUFFER_COUNT, texWidth, texHeight, format);
+	if (texResource)
 	{
 		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 		srvDesc.Format = format;
@@ -142,16 +149,24 @@ TEXTURE_HANDLE* TextureManager::CreateDynamicTexture(uint32 texWidth, uint32 tex
 		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 		srvDesc.Texture2D.MipLevels = 1;
 
-		descriptorAllocator->AllocateDescriptorHeap(&srv);
+		srvHandle = descriptorAllocator->Alloc(&srv);
 		if (srv.ptr)
 		{
-			device->CreateShaderResourceView(texResource, &srvDesc, srv);
+			descriptorAllocator->CreateShaderResourceView(srvHandle, texResource, &srvDesc);
+
+			D3D12_RESOURCE_DESC texDesc = texResource->GetDesc();
+			uint64 imageSize = 0;
+			m_renderer->GetDevice()->GetCopyableFootprints(&texDesc, 0, 1, 0, nullptr, nullptr, nullptr, &imageSize);
 
 			textureHandle = new TEXTURE_HANDLE;
 			::memset(textureHandle, 0, sizeof(TEXTURE_HANDLE));
 			textureHandle->textureResource = texResource;
-			textureHandle->uploadBuffer = uploadBuffer;
+			memcpy(textureHandle->uploadBuffers, uploadBuffers, sizeof(uploadBuffers));
+			textureHandle->image = (uint8*)malloc(imageSize);
+			textureHandle->imageSize = static_cast<uint32>(imageSize);
 			textureHandle->srv = srv;
+			textureHandle->srvHandle = srvHandle;
+			textureHandle->id = ++m_lastTextureId;
 			strcpy_s(textureHandle->name, name);
 		}
 		else
@@ -159,8 +174,11 @@ TEXTURE_HANDLE* TextureManager::CreateDynamicTexture(uint32 texWidth, uint32 tex
 			texResource->Release();
 			texResource = nullptr;
 
-			uploadBuffer->Release();
-			uploadBuffer = nullptr;
+			for (uint32 i = 0; i < TEXTURE_HANDLE::UPLOAD_BUFFER_COUNT; i++)
+			{
+				uploadBuffers[i]->Release();
+				uploadBuffers[i] = nullptr;
+			}
 		}
 	}
 
@@ -170,13 +188,13 @@ TEXTURE_HANDLE* TextureManager::CreateDynamicTexture(uint32 texWidth, uint32 tex
 TEXTURE_HANDLE* TextureManager::CreateDummyTexture(uint32 texWidth, uint32 texHeight)
 {
 	const wchar_t* filename = L"Dummy";
-	ID3D12Device5* device = m_renderer->GetDevice();
 	ID3D12Resource* texResource = nullptr;
 	ResourceManager* resourceManager = m_renderer->GetReourceManager();
 	DescriptorAllocator* descriptorAllocator = m_renderer->GetDescriptorAllocator();
 	D3D12_RESOURCE_DESC texDesc = {};
 	TEXTURE_HANDLE* textureHandle = nullptr;
 	D3D12_CPU_DESCRIPTOR_HANDLE srv = {};
+	uint32 srvHandle = 0;
 
 	uint8* image = (uint8*)malloc(texWidth * texHeight * 4);
 
@@ -196,15 +214,17 @@ TEXTURE_HANDLE* TextureManager::CreateDummyTexture(uint32 texWidth, uint32 texHe
 			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 			srvDesc.Texture2D.MipLevels = texDesc.MipLevels;
 
-			descriptorAllocator->AllocateDescriptorHeap(&srv);
+			srvHandle = descriptorAllocator->Alloc(&srv);
 			if (srv.ptr)
 			{
-				device->CreateShaderResourceView(texResource, &srvDesc, srv);
+				descriptorAllocator->CreateShaderResourceView(srvHandle, texResource, &srvDesc);
 
 				textureHandle = new TEXTURE_HANDLE;
 				::memset(textureHandle, 0, sizeof(TEXTURE_HANDLE));
 				textureHandle->textureResource = texResource;
 				textureHandle->srv = srv;
+				textureHandle->srvHandle = srvHandle;
+				textureHandle->id = ++m_lastTextureId;
 
 				HT_Insert(m_hashTable, (void*)filename, (void*)textureHandle);
 			}
@@ -229,25 +249,109 @@ void TextureManager::DestroyTexture(TEXTURE_HANDLE* textureHandle)
 
 	if (texHandle)
 	{
+		if (texHandle->isDirty)
+		{
+			DL_Delete(&m_dirtyTextureHead, &m_dirtyTextureTail, &texHandle->dirtyLink);
+			texHandle->isDirty = false;
+		}
 		if (texHandle->textureResource)
 		{
 			texHandle->textureResource->Release();
 			texHandle->textureResource = nullptr;
 		}
-		if (texHandle->uploadBuffer)
+		for (uint32 i = 0; i < TEXTURE_HANDLE::UPLOAD_BUFFER_COUNT; i++)
 		{
-			texHandle->uploadBuffer->Release();
-			texHandle->uploadBuffer = nullptr;
+			if (texHandle->uploadBuffers[i])
+			{
+				texHandle->uploadBuffers[i]->Release();
+				texHandle->uploadBuffers[i] = nullptr;
+			}
+		}
+		if (texHandle->image)
+		{
+			free(texHandle->image);
+			texHandle->image = nullptr;
 		}
 		if (texHandle->srv.ptr)
 		{
-			descriptorAllocator->FreeDecriptorHeap(texHandle->srv);
+			descriptorAllocator->Free(texHandle->srvHandle);
 		}
 
 		delete texHandle;
 	}
 }
 
+void TextureManager::MarkDirty(TEXTURE_HANDLE* textureHandle)
+{
+	if (!textureHandle->image || textureHandle->isDirty)
+	{
+		return;
+	}
+
+	DL_InsertBack(&m_dirtyTextureHead, &m_dirtyTextureTail, &textureHandle->dirtyLink);
+	textureHandle->isDirty = true;
+}
+
+uint64 TextureManager::UploadDirtyTextures(ID3D12GraphicsCommandList* cmdList, uint32 framePendingIdx)
+{
+	ID3D12Device5* device = m_renderer->GetDevice();
+	TEXTURE_HANDLE* texHandles[MAX_UPLOAD_COUNT_PER_BATCH];
+	D3D12_RESOURCE_BARRIER barriers[MAX_UPLOAD_COUNT_PER_BATCH];
+	uint64 uploadBytes = 0;
+
+	while (m_dirtyTextureHead)
+	{
+		uint32 count = 0;
+		while (m_dirtyTextureHead && count < MAX_UPLOAD_COUNT_PER_BATCH)
+		{
+			TEXTURE_HANDLE* texHandle = reinterpret_cast<TEXTURE_HANDLE*>(m_dirtyTextureHead);
+			DL_Delete(&m_dirtyTextureHead, &m_dirtyTextureTail, &texHandle->dirtyLink);
+			texHandle->isDirty = false;
+
+			texHandles[count] = texHandle;
+			barriers[count] = CD3DX12_RESOURCE_BARRIER::Transition(texHandle->textureResource, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+			count++;
+		}
+
+		cmdList->ResourceBarrier(count, barriers);
+		for (uint32 i = 0; i < count; i++)
+		{
+			TEXTURE_HANDLE* texHandle = texHandles[i];
+			ID3D12Resource* upBuffer = texHandle->uploadBuffers[framePendingIdx];
+			D3D12_RESOURCE_DESC desc = texHandle->textureResource->GetDesc();
+
+			uint8* mappedPtr = nullptr;
+			CD3DX12_RANGE readRange(0, 0);
+			ThrowIfFailed(upBuffer->Map(0, &readRange, reinterpret_cast<void**>(&mappedPtr)));
+			memcpy(mappedPtr, texHandle->image, texHandle->imageSize);
+			upBuffer->Unmap(0, nullptr);
+
+			// Dynamic textures have a single subresource.
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT footPrint = {};
+			uint64 totalBytes = 0;
+			device->GetCopyableFootprints(&desc, 0, 1, 0, &footPrint, nullptr, nullptr, &totalBytes);
+
+			D3D12_TEXTURE_COPY_LOCATION destLocation = {};
+			destLocation.pResource = texHandle->textureResource;
+			destLocation.SubresourceIndex = 0;
+			destLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+
+			D3D12_TEXTURE_COPY_LOCATION srcLocation = {};
+			srcLocation.PlacedFootprint = footPrint;
+			srcLocation.pResource = upBuffer;
+			srcLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+
+			cmdList->CopyTextureRegion(&destLocation, 0, 0, 0, &srcLocation, nullptr);
+			uploadBytes += totalBytes;
+
+			barriers[i] = CD3DX12_RESOURCE_BARRIER::Transition(texHandle->textureResource, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+		}
+		cmdList->ResourceBarrier(count, barriers);
+	}
+
+	return uploadBytes;
+}
+
 void TextureManager::CleanUp()
 {
 	for (uint32 i = 0; i < m_hashTable->tableSize; i++)
@@ -12,6 +12,8 @@ struct HashTable;
 class TextureManager
 {
 public:
+	static const uint32 MAX_UPLOAD_COUNT_PER_BATCH = 64;
+
 	TextureManager();
 	~TextureManager();
 
@@ -21,6 +23,12 @@ public:
 	TEXTURE_HANDLE* CreateDynamicTexture(uint32 texWidth, uint32 texHeight, const char* name = nullptr);
 	TEXTURE_HANDLE* CreateDummyTexture(uint32 texWidth = 1, uint32 texHeight = 1);
 	void DestroyTexture(TEXTURE_HANDLE* textureHandle);
+	// Queues a dynamic texture for the next UploadDirtyTextures. Marking it again before then is a no op.
+	void MarkDirty(TEXTURE_HANDLE* textureHandle);
+	// Copies every dirty texture once, with the transitions batched, through the upload buffers of framePendingIdx.
+	// Call once the GPU is done with the frame that last used that pending index. Returns the bytes copied.
+	uint64 UploadDirtyTextures(ID3D12GraphicsCommandList* cmdList, uint32 framePendingIdx);
+	inline bool HasDirtyTextures() { return m_dirtyTextureHead != nullptr; }
 	
 private:
 	void CleanUp();
@@ -28,5 +36,8 @@ private:
 private:
 	Renderer* m_renderer = nullptr;
 	HashTable* m_hashTable = nullptr;
+	DL_LIST* m_dirtyTextureHead = nullptr;
+	DL_LIST* m_dirtyTextureTail = nullptr;
+	uint32 m_lastTextureId = 0;
 };
 
@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "WorkStealingQueue.h"
+
+/*
+===================
+WorkStealingQueue
+===================
+*/
+
+WorkStealingQueue::WorkStealingQueue()
+{
+}
+
+WorkStealingQueue::~WorkStealingQueue()
+{
+}
+
+void WorkStealingQueue::Reset(uint32 begin, uint32 end)
+{
+	_InterlockedExchange64(&m_range, MakeRange(begin, end));
+}
+
+bool WorkStealingQueue::Pop(uint32* rangeIdx)
+{
+	while (true)
+	{
+		long long range = m_range;
+		uint32 begin = static_cast<uint32>(range);
+		uint32 end = static_cast<uint32>(range >> 32);
+
+		if (begin >= end)
+		{
+			return false;
+		}
+
+		if (_InterlockedCompareExchange64(&m_range, MakeRange(begin + 1, end), range) == range)
+		{
+			*rangeIdx = begin;
+			return true;
+		}
+	}
+}
+
+bool WorkStealingQueue::Steal(uint32* stolenBegin, uint32* stolenEnd)
+{
+	while (true)
+	{
+		long long range = m_range;
+		uint32 begin = static_cast<uint32>(range);
+		uint32 end = static_cast<uint32>(range >> 32);
+
+		if (begin >= end)
+		{
+			return false;
+		}
+
+		uint32 split = end - (end - begin + 1) / 2;
+		if (_InterlockedCompareExchange64(&m_range, MakeRange(begin, split), range) == range)
+		{
+			*stolenBegin = split;
+			*stolenEnd = end;
+			return true;
+		}
+	}
+}
+
+long long WorkStealingQueue::MakeRange(uint32 begin, uint32 end)
+{
+	return static_cast<long long>((static_cast<uint64>(end) << 32) | begin);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+===================
+WorkStealingQueue
+===================
+*/
+
+// Holds a contiguous block of job range indices [begin, end).
+// The owner thread pops from the front, other threads steal the back half in one go so a thief keeps working on
+// neighbouring ranges.
+class WorkStealingQueue
+{
+public:
+	WorkStealingQueue();
+	~WorkStealingQueue();
+
+	void Reset(uint32 begin, uint32 end);
+	bool Pop(uint32* rangeIdx);
+	// Takes half of what is left, rounded up, off the back.
+	bool Steal(uint32* stolenBegin, uint32* stolenEnd);
+
+private:
+	static long long MakeRange(uint32 begin, uint32 end);
+
+private:
+	// [63:32] end | [31:0] begin, both ends move with a single CAS.
+	volatile long long m_range = 0;
+	// Keep every thread's queue on its own cache line.
+	uint8 m_padding[64 - sizeof(long long)] = {};
+};
@@ -1,5 +1,12 @@
 #pragma once
 
+// std lib, ahead of the debug new below
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #ifdef _DEBUG
 	#define _CRTDBG_MAP_ALLOC
 	#include <crtdbg.h>
@@ -29,4 +36,4 @@ using namespace DirectX;
 #include "../../CommonLib/CommonLib/GenericUtils.h"
 #include "D3DUtils.h"
 #include "RendererType.h"
-#include "RenderThread.h"
+#include "RenderThreadPool.h"
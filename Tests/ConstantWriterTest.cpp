@@ -0,0 +1,67 @@
+#include "pch.h"
+#include "ConstantWriter.h"
+#include "TestUtils.h"
+
+/*
+=================
+ConstantWriter Test
+=================
+*/
+
+static const uint8 GUARD_BYTE = 0xcd;
+
+static bool CheckWrite(uint32 size)
+{
+	alignas(ConstantWriter::LINE_SIZE) uint8 dest[ConstantWriter::LINE_SIZE * 4];
+	uint8 src[ConstantWriter::LINE_SIZE * 3];
+	memset(dest, GUARD_BYTE, sizeof(dest));
+	for (uint32 i = 0; i < sizeof(src); i++)
+	{
+		src[i] = static_cast<uint8>(i + 1);
+	}
+
+	ConstantWriter::Write(dest, src, size);
+	ConstantWriter::Flush();
+
+	uint32 writtenSize = (size + ConstantWriter::LINE_SIZE - 1) / ConstantWriter::LINE_SIZE * ConstantWriter::LINE_SIZE;
+	TEST_CHECK(memcmp(dest, src, size) == 0);
+	for (uint32 i = size; i < writtenSize; i++)
+	{
+		TEST_CHECK(dest[i] == 0);
+	}
+	// Nothing past the last line.
+	for (uint32 i = writtenSize; i < sizeof(dest); i++)
+	{
+		TEST_CHECK(dest[i] == GUARD_BYTE);
+	}
+
+	return true;
+}
+
+static bool TestWholeLines()
+{
+	TEST_CHECK(CheckWrite(ConstantWriter::LINE_SIZE));
+	TEST_CHECK(CheckWrite(ConstantWriter::LINE_SIZE * 3));
+
+	return true;
+}
+
+static bool TestTailPadding()
+{
+	TEST_CHECK(CheckWrite(1));
+	TEST_CHECK(CheckWrite(sizeof(float) * 16 + 4));
+	TEST_CHECK(CheckWrite(ConstantWriter::LINE_SIZE * 2 + 63));
+
+	return true;
+}
+
+int main()
+{
+	const TEST_CASE testCases[] =
+	{
+		{ "WholeLines", TestWholeLines },
+		{ "TailPadding", TestTailPadding },
+	};
+
+	return RunTests(testCases, sizeof(testCases) / sizeof(testCases[0]));
+}
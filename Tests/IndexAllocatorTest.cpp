@@ -0,0 +1,137 @@
+#include "pch.h"
+#include "IndexAllocator.h"
+#include "TestUtils.h"
+
+/*
+=================
+IndexAllocator Test
+=================
+*/
+
+static bool TestAllocLowestFirst()
+{
+	IndexAllocator allocator;
+	allocator.Initialize(130);
+
+	// Past the first 64 bit word, the summary has to point at the next one.
+	for (uint32 i = 0; i < 130; i++)
+	{
+		uint32 handle = allocator.Alloc();
+		TEST_CHECK(handle != IndexAllocator::INVALID_HANDLE);
+		TEST_CHECK(IndexAllocator::GetIndex(handle) == i);
+		TEST_CHECK(IndexAllocator::GetGeneration(handle) == 0);
+	}
+	TEST_CHECK(allocator.GetAllocatedCount() == 130);
+
+	TEST_CHECK(allocator.Alloc() == IndexAllocator::INVALID_HANDLE);
+	TEST_CHECK(allocator.GetFailedAllocCount() == 1);
+
+	return true;
+}
+
+static bool TestFreeReusesIndex()
+{
+	IndexAllocator allocator;
+	allocator.Initialize(256);
+
+	uint32 handles[100] = {};
+	for (uint32 i = 0; i < 100; i++)
+	{
+		handles[i] = allocator.Alloc();
+	}
+
+	TEST_CHECK(allocator.Free(handles[70]));
+	TEST_CHECK(allocator.Free(handles[3]));
+	TEST_CHECK(allocator.GetAllocatedCount() == 98);
+	TEST_CHECK(allocator.GetHighWaterMark() == 100);
+
+	uint32 handle = allocator.Alloc();
+	TEST_CHECK(IndexAllocator::GetIndex(handle) == 3);
+	handle = allocator.Alloc();
+	TEST_CHECK(IndexAllocator::GetIndex(handle) == 70);
+	handle = allocator.Alloc();
+	TEST_CHECK(IndexAllocator::GetIndex(handle) == 100);
+
+	return true;
+}
+
+static bool TestStaleGeneration()
+{
+	IndexAllocator allocator;
+	allocator.Initialize(16);
+
+	uint32 oldHandle = allocator.Alloc();
+	TEST_CHECK(allocator.IsValid(oldHandle));
+	TEST_CHECK(allocator.Free(oldHandle));
+	TEST_CHECK(!allocator.IsValid(oldHandle));
+
+	// Double free.
+	TEST_CHECK(!allocator.Free(oldHandle));
+	TEST_CHECK(allocator.GetStaleFreeCount() == 1);
+
+	// The same index comes back under a new generation, the old handle stays stale.
+	uint32 newHandle = allocator.Alloc();
+	TEST_CHECK(IndexAllocator::GetIndex(newHandle) == IndexAllocator::GetIndex(oldHandle));
+	TEST_CHECK(IndexAllocator::GetGeneration(newHandle) == IndexAllocator::GetGeneration(oldHandle) + 1);
+	TEST_CHECK(allocator.IsValid(newHandle));
+	TEST_CHECK(!allocator.IsValid(oldHandle));
+
+	// Use after free must not release the new owner's index.
+	TEST_CHECK(!allocator.Free(oldHandle));
+	TEST_CHECK(allocator.GetStaleFreeCount() == 2);
+	TEST_CHECK(allocator.IsValid(newHandle));
+
+	TEST_CHECK(!allocator.IsValid(IndexAllocator::INVALID_HANDLE));
+	TEST_CHECK(!allocator.Free(IndexAllocator::INVALID_HANDLE));
+
+	return true;
+}
+
+static bool TestAllocRange()
+{
+	IndexAllocator allocator;
+	allocator.Initialize(200);
+
+	uint32 handles[8] = {};
+	for (uint32 i = 0; i < 8; i++)
+	{
+		handles[i] = allocator.Alloc();
+	}
+	// Holes of 1 and 2 are too short for a run of 3.
+	allocator.Free(handles[2]);
+	allocator.Free(handles[4]);
+	allocator.Free(handles[5]);
+
+	uint32 rangeHandle = allocator.AllocRange(3);
+	TEST_CHECK(rangeHandle != IndexAllocator::INVALID_HANDLE);
+	TEST_CHECK(IndexAllocator::GetIndex(rangeHandle) == 8);
+	TEST_CHECK(allocator.GetAllocatedCount() == 8);
+
+	uint32 pairHandle = allocator.AllocRange(2);
+	TEST_CHECK(IndexAllocator::GetIndex(pairHandle) == 4);
+
+	// A run crossing a word boundary.
+	uint32 wideHandle = allocator.AllocRange(100);
+	TEST_CHECK(IndexAllocator::GetIndex(wideHandle) == 11);
+	TEST_CHECK(allocator.AllocRange(100) == IndexAllocator::INVALID_HANDLE);
+
+	TEST_CHECK(allocator.FreeRange(wideHandle, 100));
+	TEST_CHECK(!allocator.IsValid(wideHandle));
+	TEST_CHECK(!allocator.FreeRange(wideHandle, 100));
+	TEST_CHECK(allocator.AllocRange(100) != IndexAllocator::INVALID_HANDLE);
+
+	return true;
+}
+
+int main()
+{
+	const TEST_CASE testCases[] =
+	{
+		{ "AllocLowestFirst", TestAllocLowestFirst },
+		{ "FreeReusesIndex", TestFreeReusesIndex },
+		{ "StaleGeneration", TestStaleGeneration },
+		{ "AllocRange", TestAllocRange },
+	};
+
+	return RunTests(testCases, sizeof(testCases) / sizeof(testCases[0]));
+}
@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "TestUtils.h"
+
+/*
+=================
+RenderThreadPool Test
+=================
+*/
+
+static const uint32 THREAD_COUNT = 4;
+
+struct RUN_COUNTER
+{
+	std::atomic<uint32> runCounts[THREAD_COUNT] = {};
+};
+
+static void CountRun(void* context, uint32 threadIdx)
+{
+	RUN_COUNTER* counter = reinterpret_cast<RUN_COUNTER*>(context);
+	counter->runCounts[threadIdx].fetch_add(1);
+}
+
+static bool TestDispatch()
+{
+	RUN_COUNTER counter;
+	RenderThreadPool pool;
+	pool.Initialize(THREAD_COUNT, CountRun, &counter);
+
+	for (uint32 i = 0; i < 1000; i++)
+	{
+		pool.Dispatch(THREAD_COUNT);
+	}
+	for (uint32 i = 0; i < THREAD_COUNT; i++)
+	{
+		TEST_CHECK(counter.runCounts[i].load() == 1000);
+	}
+
+	return true;
+}
+
+static bool TestActiveThreadCount()
+{
+	RUN_COUNTER counter;
+	RenderThreadPool pool;
+	pool.Initialize(THREAD_COUNT, CountRun, &counter);
+
+	for (uint32 i = 0; i < 100; i++)
+	{
+		pool.Dispatch(2);
+	}
+	pool.Dispatch(THREAD_COUNT);
+	// More than the pool has is clamped, none is a no op.
+	pool.Dispatch(THREAD_COUNT * 2);
+	pool.Dispatch(0);
+
+	TEST_CHECK(counter.runCounts[0].load() == 102);
+	TEST_CHECK(counter.runCounts[1].load() == 102);
+	TEST_CHECK(counter.runCounts[2].load() == 2);
+	TEST_CHECK(counter.runCounts[3].load() == 2);
+
+	return true;
+}
+
+static bool TestParkAndWake()
+{
+	RUN_COUNTER counter;
+	RenderThreadPool pool;
+	pool.Initialize(THREAD_COUNT, CountRun, &counter);
+
+	// Idle far longer than the spin, every worker parks on the condition variable.
+	for (uint32 i = 0; i < 200 && pool.GetParkCount() < THREAD_COUNT; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	TEST_CHECK(pool.GetParkCount() >= THREAD_COUNT);
+
+	// A dispatch wakes the parked workers.
+	pool.DispatchAsync(THREAD_COUNT);
+	pool.WaitForCompletion();
+	TEST_CHECK(!pool.IsBusy());
+	for (uint32 i = 0; i < THREAD_COUNT; i++)
+	{
+		TEST_CHECK(counter.runCounts[i].load() == 1);
+	}
+
+	return true;
+}
+
+static bool TestDestroyWhileParked()
+{
+	RUN_COUNTER counter;
+	{
+		RenderThreadPool pool;
+		pool.Initialize(THREAD_COUNT, CountRun, &counter);
+		pool.Dispatch(THREAD_COUNT);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	// The exit wake up does not run the function.
+	for (uint32 i = 0; i < THREAD_COUNT; i++)
+	{
+		TEST_CHECK(counter.runCounts[i].load() == 1);
+	}
+
+	return true;
+}
+
+int main()
+{
+	const TEST_CASE testCases[] =
+	{
+		{ "Dispatch", TestDispatch },
+		{ "ActiveThreadCount", TestActiveThreadCount },
+		{ "ParkAndWake", TestParkAndWake },
+		{ "DestroyWhileParked", TestDestroyWhileParked },
+	};
+
+	return RunTests(testCases, sizeof(testCases) / sizeof(testCases[0]));
+}
@@ -0,0 +1,142 @@
+#include "pch.h"
+#include "TaskGraph.h"
+#include "TestUtils.h"
+
+/*
+=================
+TaskGraph Test
+=================
+*/
+
+static const uint32 WORKER_COUNT = 4;
+static const uint32 MAX_ITEM_COUNT = 64;
+
+// Every item stamps when it started and finished on one clock shared by all workers.
+struct ORDER_TASK_CONTEXT
+{
+	std::atomic<uint32>* clock = nullptr;
+	std::atomic<uint32> runCounts[MAX_ITEM_COUNT] = {};
+	uint32 beginStamps[MAX_ITEM_COUNT] = {};
+	uint32 endStamps[MAX_ITEM_COUNT] = {};
+	uint32 itemCount = 0;
+};
+
+static void OrderTask(void* context, uint32 itemIdx)
+{
+	ORDER_TASK_CONTEXT* orderContext = reinterpret_cast<ORDER_TASK_CONTEXT*>(context);
+	orderContext->beginStamps[itemIdx] = orderContext->clock->fetch_add(1);
+	orderContext->runCounts[itemIdx].fetch_add(1);
+	std::this_thread::yield();
+	orderContext->endStamps[itemIdx] = orderContext->clock->fetch_add(1);
+}
+
+static uint32 GetFirstBegin(const ORDER_TASK_CONTEXT* context)
+{
+	uint32 firstBegin = 0xffffffff;
+	for (uint32 i = 0; i < context->itemCount; i++)
+	{
+		firstBegin = context->beginStamps[i] < firstBegin ? context->beginStamps[i] : firstBegin;
+	}
+	return firstBegin;
+}
+
+static uint32 GetLastEnd(const ORDER_TASK_CONTEXT* context)
+{
+	uint32 lastEnd = 0;
+	for (uint32 i = 0; i < context->itemCount; i++)
+	{
+		lastEnd = context->endStamps[i] > lastEnd ? context->endStamps[i] : lastEnd;
+	}
+	return lastEnd;
+}
+
+static void RunOnWorkers(TaskGraph* graph)
+{
+	std::thread workers[WORKER_COUNT - 1];
+	for (uint32 i = 0; i < WORKER_COUNT - 1; i++)
+	{
+		workers[i] = std::thread(&TaskGraph::Run, graph);
+	}
+	graph->Run();
+	for (uint32 i = 0; i < WORKER_COUNT - 1; i++)
+	{
+		workers[i].join();
+	}
+}
+
+static bool TestEveryItemOnce()
+{
+	std::atomic<uint32> clock = { 0 };
+	ORDER_TASK_CONTEXT context;
+	context.clock = &clock;
+	context.itemCount = MAX_ITEM_COUNT;
+
+	TaskGraph graph;
+	graph.Reset();
+	graph.AddTask(OrderTask, &context, context.itemCount);
+	RunOnWorkers(&graph);
+
+	for (uint32 i = 0; i < context.itemCount; i++)
+	{
+		TEST_CHECK(context.runCounts[i].load() == 1);
+	}
+
+	return true;
+}
+
+static bool TestDependencyOrder()
+{
+	// gather -> count -> scatter -> record, with a fan in of gather and an empty task into submit.
+	std::atomic<uint32> clock = { 0 };
+	ORDER_TASK_CONTEXT contexts[6];
+	const uint32 itemCounts[6] = { 16, 8, 8, 0, 4, 1 };
+
+	for (uint32 frame = 0; frame < 50; frame++)
+	{
+		TaskGraph graph;
+		graph.Reset();
+		for (uint32 i = 0; i < 6; i++)
+		{
+			for (uint32 j = 0; j < MAX_ITEM_COUNT; j++)
+			{
+				contexts[i].runCounts[j].store(0);
+			}
+			contexts[i].clock = &clock;
+			contexts[i].itemCount = itemCounts[i];
+			graph.AddTask(OrderTask, &contexts[i], itemCounts[i]);
+		}
+		graph.AddDependency(1, 0);
+		graph.AddDependency(2, 1);
+		graph.AddDependency(4, 2);
+		graph.AddDependency(4, 3);
+		graph.AddDependency(5, 4);
+		graph.AddDependency(5, 0);
+		RunOnWorkers(&graph);
+
+		for (uint32 i = 0; i < 6; i++)
+		{
+			for (uint32 j = 0; j < contexts[i].itemCount; j++)
+			{
+				TEST_CHECK(contexts[i].runCounts[j].load() == 1);
+			}
+		}
+		TEST_CHECK(GetLastEnd(&contexts[0]) < GetFirstBegin(&contexts[1]));
+		TEST_CHECK(GetLastEnd(&contexts[1]) < GetFirstBegin(&contexts[2]));
+		TEST_CHECK(GetLastEnd(&contexts[2]) < GetFirstBegin(&contexts[4]));
+		TEST_CHECK(GetLastEnd(&contexts[4]) < GetFirstBegin(&contexts[5]));
+		TEST_CHECK(GetLastEnd(&contexts[0]) < GetFirstBegin(&contexts[5]));
+	}
+
+	return true;
+}
+
+int main()
+{
+	const TEST_CASE testCases[] =
+	{
+		{ "EveryItemOnce", TestEveryItemOnce },
+		{ "DependencyOrder", TestDependencyOrder },
+	};
+
+	return RunTests(testCases, sizeof(testCases) / sizeof(testCases[0]));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+=================
+Test Utils
+=================
+*/
+
+// Fails the running test function.
+#define TEST_CHECK(condition) \
+	if (!(condition)) \
+	{ \
+		printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition); \
+		return false; \
+	}
+
+typedef bool (*TEST_FUNC)();
+
+struct TEST_CASE
+{
+	const char* name;
+	TEST_FUNC func;
+};
+
+// Runs every case and returns the process exit code.
+inline int RunTests(const TEST_CASE* testCases, uint32 testCount)
+{
+	uint32 failedCount = 0;
+	for (uint32 i = 0; i < testCount; i++)
+	{
+		bool passed = testCases[i].func();
+		printf("%s %s\n", passed ? "[PASS]" : "[FAIL]", testCases[i].name);
+		if (!passed)
+		{
+			failedCount++;
+		}
+	}
+
+	return failedCount ? 1 : 0;
+}
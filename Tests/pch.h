@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+=================
+Test pch
+=================
+*/
+
+// Stands in for RendererD3D12/pch.h when building the platform independent parts of the renderer for the tests.
+
+// std lib
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+typedef int8_t int8;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef int64_t int64;
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#else
+	#define __debugbreak() __builtin_trap()
+#endif
+
+#include "RenderThreadPool.h"